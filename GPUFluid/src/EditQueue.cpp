@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include "EditQueue.hpp"
+
+EditQueue::EditQueue() : _head(0), _tail(0) {
+}
+
+/* Producer side. Returns false if the consumer has fallen a full queue behind */
+bool EditQueue::push(const SceneEdit &edit) {
+    unsigned head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) == Capacity)
+        return false;
+
+    _edits[head % Capacity] = edit;
+    _head.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+/* Consumer side. Returns false once the queue is empty */
+bool EditQueue::pop(SceneEdit &edit) {
+    unsigned tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire))
+        return false;
+
+    edit = _edits[tail % Capacity];
+    _tail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+static SceneEdit makeEdit(EditType type, int index, float x, float y, float w, float h, float value) {
+    SceneEdit edit;
+    edit.type  = type;
+    edit.index = index;
+    edit.x     = x;
+    edit.y     = y;
+    edit.w     = w;
+    edit.h     = h;
+    edit.value = value;
+
+    return edit;
+}
+
+bool EditQueue::addInflow(float x, float y, float w, float h, float temperature) {
+    return push(makeEdit(EDIT_ADD_INFLOW, 0, x, y, w, h, temperature));
+}
+
+bool EditQueue::moveInflow(int index, float x, float y) {
+    return push(makeEdit(EDIT_MOVE_INFLOW, index, x, y, 0.0f, 0.0f, 0.0f));
+}
+
+bool EditQueue::removeInflow(int index) {
+    return push(makeEdit(EDIT_REMOVE_INFLOW, index, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+bool EditQueue::addSolidBox(float x, float y, float w, float h) {
+    return push(makeEdit(EDIT_SOLID_BOX, 0, x, y, w, h, 0.0f));
+}
+
+bool EditQueue::addSolidCircle(float x, float y, float r) {
+    return push(makeEdit(EDIT_SOLID_CIRCLE, 0, x, y, 0.0f, 0.0f, r));
+}
+
+bool EditQueue::clearSolids() {
+    return push(makeEdit(EDIT_CLEAR_SOLIDS, 0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+bool EditQueue::setParameter(FluidParameter parameter, float value) {
+    return push(makeEdit(EDIT_PARAMETER, parameter, 0.0f, 0.0f, 0.0f, 0.0f, value));
+}
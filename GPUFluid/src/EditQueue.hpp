@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef EDITQUEUE_HPP_
+#define EDITQUEUE_HPP_
+
+#include <atomic>
+
+enum EditType {
+    EDIT_ADD_INFLOW,
+    EDIT_MOVE_INFLOW,
+    EDIT_REMOVE_INFLOW,
+    EDIT_SOLID_BOX,
+    EDIT_SOLID_CIRCLE,
+    EDIT_CLEAR_SOLIDS,
+    EDIT_PARAMETER
+};
+
+enum FluidParameter {
+    PARAM_GRAVITY,
+    PARAM_DIFFUSION,
+    PARAM_DENSITY,
+    PARAM_AMBIENT_TEMPERATURE,
+    PARAM_VORTICITY
+};
+
+/* One scene change. Positions and sizes are in domain units, as for
+ * Fluid::addSolidBox; value is the inflow temperature, circle radius or
+ * new parameter value, and index the inflow or parameter concerned */
+struct SceneEdit {
+    EditType type;
+    int index;
+    float x, y, w, h;
+    float value;
+};
+
+/* Single producer, single consumer ring of scene edits. The UI thread
+ * pushes, the simulation drains the queue at the start of each step;
+ * neither side ever blocks or takes a lock. A full queue drops the edit. */
+class EditQueue {
+    static const unsigned Capacity = 256;
+
+    SceneEdit _edits[Capacity];
+
+    /* Written by one side each; padded onto separate cache lines */
+    char _pad0[64];
+    std::atomic<unsigned> _head;
+    char _pad1[64];
+    std::atomic<unsigned> _tail;
+    char _pad2[64];
+
+public:
+    EditQueue();
+
+    bool push(const SceneEdit &edit);
+    bool pop(SceneEdit &edit);
+
+    bool addInflow(float x, float y, float w, float h, float temperature);
+    bool moveInflow(int index, float x, float y);
+    bool removeInflow(int index);
+    bool addSolidBox(float x, float y, float w, float h);
+    bool addSolidCircle(float x, float y, float r);
+    bool clearSolids();
+    bool setParameter(FluidParameter parameter, float value);
+};
+
+#endif /* EDITQUEUE_HPP_ */
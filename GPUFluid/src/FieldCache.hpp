@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef FIELDCACHE_HPP_
+#define FIELDCACHE_HPP_
+
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+
+#include "FieldCacheFormat.hpp"
+
+class Texture;
+
+/* Appends snapshots of simulation fields to a tiled cache file (see
+ * FieldCacheFormat.hpp). Fields are read back on the calling thread;
+ * tiling, quantization and compression run on worker threads, which also
+ * append finished frames to the file in order. */
+class FieldCache {
+    static const int MaxPendingFrames = 4;
+
+    struct Frame;
+
+    struct Field {
+        Frame *frame;
+        CacheField header;
+        float *values;
+
+        std::vector<CacheTile> tiles;
+        std::vector<unsigned char> data;
+        bool compress;
+    };
+
+    struct Frame {
+        CacheFrame header;
+        std::vector<Field *> fields;
+        int remaining;
+    };
+
+    FILE *_fp;
+    CacheHeader _header;
+    std::vector<CacheIndexEntry> _index;
+    uint64_t _fileSize;
+
+    std::thread *_threads;
+    int _threadCount;
+
+    std::mutex _mutex;
+    std::condition_variable _jobAdded, _frameDone;
+    std::deque<Frame *> _frames;
+    std::deque<Field *> _jobs;
+    Frame *_current;
+    bool _writing;
+    bool _quit;
+
+    void run();
+    void encode(Field &field);
+    void writeFrame(Frame &frame);
+    void releaseFrames(std::unique_lock<std::mutex> &lock);
+    Field *newField(const char *name, int width, int height, CacheEncoding encoding, bool compress);
+
+public:
+    FieldCache(const char *path, int tileSize = 32, int threads = 2);
+    ~FieldCache();
+
+    void beginFrame(int frame, float time);
+    void addField(const char *name, Texture &src, CacheEncoding encoding = CACHE_FLOAT32, bool compress = true);
+    void addField(const char *name, const float *values, int width, int height,
+            CacheEncoding encoding = CACHE_FLOAT32, bool compress = true);
+    void endFrame();
+    void flush();
+};
+
+#endif /* FIELDCACHE_HPP_ */
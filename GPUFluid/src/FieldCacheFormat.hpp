@@ -0,0 +1,158 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef FIELDCACHEFORMAT_HPP_
+#define FIELDCACHEFORMAT_HPP_
+
+#include <string.h>
+#include <stdint.h>
+
+/* On-disk layout of a field cache, little endian throughout:
+ *
+ *   CacheHeader
+ *   frame 0: CacheFrame, CacheField[fieldCount],
+ *            CacheTile[tilesX*tilesY] per field, tile data per field
+ *   frame 1: ...
+ *   CacheIndexEntry[frameCount]
+ *
+ * Offsets inside a frame are relative to the start of its CacheFrame, so
+ * a frame can be located and decoded without touching any other frame.
+ * Frames are padded to 8 bytes. Tile data holds the tile's values (rows
+ * clipped at the field edge) split into byte planes, which deflate much
+ * better than interleaved floats.
+ * The index at the end is only written when the cache is closed; readers
+ * fall back to walking the frame sizes if it is missing. */
+
+static const char     CacheMagic[8] = {'G', 'P', 'U', 'F', 'C', 'A', 'C', 'H'};
+static const uint32_t CacheVersion  = 1;
+static const uint32_t FrameMagic    = 0x4D415246; /* "FRAM" */
+
+enum CacheEncoding {
+    CACHE_FLOAT32,
+    CACHE_FLOAT16
+};
+
+enum CacheTileFlags {
+    /* No data stored; offset holds the bits of the value filling the tile */
+    TILE_CONSTANT   = (1 << 0),
+    /* Byte planes deflated in zlib format rather than stored */
+    TILE_COMPRESSED = (1 << 1)
+};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tileSize;
+    uint64_t indexOffset;
+    uint32_t frameCount;
+    uint32_t reserved;
+};
+
+struct CacheFrame {
+    uint32_t magic;
+    uint32_t frame;
+    float time;
+    uint32_t fieldCount;
+    uint64_t size;
+};
+
+struct CacheField {
+    char name[16];
+    uint32_t width, height;
+    uint32_t tilesX, tilesY;
+    uint32_t encoding;
+    uint32_t reserved;
+    uint64_t tileOffset;
+    uint64_t dataOffset;
+};
+
+struct CacheTile {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t flags;
+};
+
+struct CacheIndexEntry {
+    uint64_t offset;
+    uint32_t frame;
+    float time;
+};
+
+static inline uint16_t floatToHalf(float f) {
+    uint32_t x;
+    memcpy(&x, &f, 4);
+
+    uint32_t sign = (x >> 16) & 0x8000;
+    int32_t exponent = int32_t((x >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = x & 0x7FFFFF;
+
+    if (((x >> 23) & 0xFF) == 0xFF)
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 0x1F)
+        return sign | 0x7C00;
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1)))
+            half++;
+        return sign | half;
+    }
+
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return half;
+}
+
+static inline float halfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t x;
+
+    if (exponent == 0x1F)
+        x = sign | 0x7F800000 | (mantissa << 13);
+    else if (exponent)
+        x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    else if (mantissa) {
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        x = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    } else
+        x = sign;
+
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+#endif /* FIELDCACHEFORMAT_HPP_ */
@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FieldCacheReader.hpp"
+#include "lodepng/lodepng.h"
+#include "Debug.hpp"
+
+using namespace std;
+
+FieldCacheReader::FieldCacheReader(const char *path) : _data(0), _size(0), _mapping(0), _header(0) {
+    _file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (_file == INVALID_HANDLE_VALUE) {
+        DBG("FieldCache", WARN, "Unable to open field cache %s\n", path);
+        return;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart < (LONGLONG)sizeof(CacheHeader)) {
+        DBG("FieldCache", WARN, "Field cache %s is truncated\n", path);
+        return;
+    }
+
+    _mapping = CreateFileMapping(_file, 0, PAGE_READONLY, 0, 0, 0);
+    void *data = _mapping ? MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+    if (!data) {
+        DBG("FieldCache", WARN, "Unable to map field cache %s\n", path);
+        return;
+    }
+    _data = (const unsigned char *)data;
+    _size = size.QuadPart;
+
+    const CacheHeader *header = (const CacheHeader *)_data;
+    if (memcmp(header->magic, CacheMagic, sizeof(CacheMagic)) || header->version != CacheVersion) {
+        DBG("FieldCache", WARN, "%s is not a field cache\n", path);
+        return;
+    }
+    _header = header;
+
+    buildIndex();
+}
+
+FieldCacheReader::~FieldCacheReader() {
+    if (_data)
+        UnmapViewOfFile(_data);
+    if (_mapping)
+        CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE)
+        CloseHandle(_file);
+}
+
+/* Caches that were not closed cleanly have no index; recover every frame
+ * that made it to disk in full */
+void FieldCacheReader::buildIndex() {
+    uint64_t indexSize = uint64_t(_header->frameCount)*sizeof(CacheIndexEntry);
+    if (_header->indexOffset && _header->indexOffset + indexSize <= _size) {
+        const CacheIndexEntry *index = (const CacheIndexEntry *)(_data + _header->indexOffset);
+        for (uint32_t i = 0; i < _header->frameCount; i++)
+            _frames.push_back(index[i].offset);
+        return;
+    }
+
+    uint64_t offset = sizeof(CacheHeader);
+    while (offset + sizeof(CacheFrame) <= _size) {
+        const CacheFrame *frame = (const CacheFrame *)(_data + offset);
+        if (frame->magic != FrameMagic || frame->size < sizeof(CacheFrame) || offset + frame->size > _size)
+            break;
+        _frames.push_back(offset);
+        offset += frame->size;
+    }
+}
+
+const unsigned char *FieldCacheReader::frameBase(int frame) const {
+    ASSERT(frame >= 0 && frame < (int)_frames.size(), "Cache frame %d out of range\n", frame);
+    return _data + _frames[frame];
+}
+
+const CacheFrame &FieldCacheReader::frame(int frame) const {
+    return *(const CacheFrame *)frameBase(frame);
+}
+
+const CacheField &FieldCacheReader::field(int frame, int field) const {
+    ASSERT(field >= 0 && field < (int)this->frame(frame).fieldCount, "Cache field %d out of range\n", field);
+    return ((const CacheField *)(frameBase(frame) + sizeof(CacheFrame)))[field];
+}
+
+int FieldCacheReader::findField(int frame, const char *name) const {
+    for (uint32_t i = 0; i < this->frame(frame).fieldCount; i++)
+        if (!strncmp(field(frame, i).name, name, sizeof(CacheField().name)))
+            return i;
+    return -1;
+}
+
+void FieldCacheReader::readTile(int frame, int field, int tx, int ty, float *dst, int stride) const {
+    const unsigned char *base = frameBase(frame);
+    const CacheField &f = this->field(frame, field);
+    ASSERT(tx >= 0 && ty >= 0 && tx < (int)f.tilesX && ty < (int)f.tilesY, "Cache tile out of range\n");
+
+    const CacheTile &tile = ((const CacheTile *)(base + f.tileOffset))[tx + ty*f.tilesX];
+    int tileSize = _header->tileSize;
+    int w = min(tileSize, (int)f.width  - tx*tileSize);
+    int h = min(tileSize, (int)f.height - ty*tileSize);
+    int count = w*h;
+    int bytes = f.encoding == CACHE_FLOAT16 ? 2 : 4;
+
+    if (tile.flags & TILE_CONSTANT) {
+        float value;
+        if (bytes == 2)
+            value = halfToFloat(uint16_t(tile.offset));
+        else {
+            uint32_t bits = uint32_t(tile.offset);
+            memcpy(&value, &bits, 4);
+        }
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                dst[x + y*stride] = value;
+        return;
+    }
+
+    const unsigned char *planes = base + f.dataOffset + tile.offset;
+    unsigned char *inflated = 0;
+    if (tile.flags & TILE_COMPRESSED) {
+        size_t size = 0;
+        LodePNGDecompressSettings settings;
+        lodepng_decompress_settings_init(&settings);
+        unsigned error = lodepng_zlib_decompress(&inflated, &size, planes, tile.size, &settings);
+        ASSERT(!error && size == size_t(count*bytes), "Corrupt cache tile %d,%d of %s\n", tx, ty, f.name);
+        planes = inflated;
+    }
+
+    for (int y = 0, i = 0; y < h; y++) {
+        for (int x = 0; x < w; x++, i++) {
+            unsigned char value[4];
+            for (int b = 0; b < bytes; b++)
+                value[b] = planes[b*count + i];
+
+            if (bytes == 2) {
+                uint16_t half;
+                memcpy(&half, value, 2);
+                dst[x + y*stride] = halfToFloat(half);
+            } else
+                memcpy(&dst[x + y*stride], value, 4);
+        }
+    }
+
+    free(inflated);
+}
+
+void FieldCacheReader::readField(int frame, int field, float *dst) const {
+    const CacheField &f = this->field(frame, field);
+    int tileSize = _header->tileSize;
+
+    for (uint32_t ty = 0; ty < f.tilesY; ty++)
+        for (uint32_t tx = 0; tx < f.tilesX; tx++)
+            readTile(frame, field, tx, ty, dst + tx*tileSize + ty*tileSize*f.width, f.width);
+}
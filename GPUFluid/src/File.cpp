@@ -36,6 +36,33 @@ int fsize(FILE *fp) {
     fseek(fp, prev, SEEK_SET);
     return size;
 }
+
+/* Grows with allocated blocks rather than a sparse hole. Only works on
+ * regular files */
+#ifdef _WIN32
+#include <io.h>
+
+bool fresize(FILE *fp, long long size) {
+    fflush(fp);
+    return _chsize_s(_fileno(fp), size) == 0;
+}
+#else
+#include <unistd.h>
+
+bool fresize(FILE *fp, long long size) {
+    struct stat info;
+    int file = fileno(fp);
+
+    fflush(fp);
+    if (fstat(file, &info) || !S_ISREG(info.st_mode))
+        return false;
+
+    if (size > info.st_size)
+        return posix_fallocate(file, 0, size) == 0;
+    else
+        return ftruncate(file, size) == 0;
+}
+#endif
 #ifdef _WIN32
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -24,10 +24,15 @@ freely, subject to the following restrictions:
 #include <algorithm>
 #include <GL/glew.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <math.h>
 
 #include "Fluid.hpp"
+#include "EditQueue.hpp"
+#include "render/FramebufferCache.hpp"
+#include "render/AsyncReadback.hpp"
+#include "render/StreamBuffer.hpp"
 #include "render/RenderTarget.hpp"
 #include "render/BufferObject.hpp"
 #include "render/Texture.hpp"
@@ -38,23 +43,50 @@ freely, subject to the following restrictions:
 
 using namespace std;
 
+/* The estimated timestep comes from a velocity up to a few frames old, so
+ * leave headroom for the flow speeding up in the meantime */
+static const float TimestepSafety = 0.75f;
+
+/* DrawArraysIndirectCommand per tile list: 4 vertices, no instances */
+static const GLuint emptyTileCommands[] = {
+    4, 0, 0, 0,
+    4, 0, 0, 0,
+    4, 0, 0, 0
+};
+
 Fluid::Fluid(int width, int height) : _width(width), _height(height) {
     _tWidth  = _width;
     _tHeight = _height;
 
-    makePreamble("../src/shaders/Preamble.txt", "../src/shaders/Fluid/Preamble.txt");
+    makePreamble("../src/shaders/Preamble.txt", "../src/shaders/Fluid/ComputeSolver.txt", "../src/shaders/Fluid/Preamble.txt", "../src/shaders/Fluid/ComputePreamble.txt");
 
-    _rt = new RenderTarget();
+    _fbos = new FramebufferCache();
 
     _hX = 1.0f/min(_width, _height);
     _density   = 1.0f;
     _diffusion = 0.05f;
     _gravity   = -9.81f;
     _tAmb      = 22.0f;
+    _vorticity = 1.0f;
 
     _heatIters     = 80;
     _pressureIters = 160;
 
+    _heatSolver     = CG_STANDARD;
+    _pressureSolver = CG_PIPELINED;
+
+    _advection   = ADVECT_PARTICLES;
+    _cfl         = 2.0f;
+    _maxTimestep = 0.25e-3f;
+
+    _transfer   = TRANSFER_FLIP;
+    _minPerCell = 3;
+    _maxPerCell = 8;
+
+    _binning = BIN_ATOMIC;
+    /* Whole digits, with one key left over past the last cell for padding */
+    for (_sortBits = 4; (1 << _sortBits) <= _width*_height; _sortBits += 4);
+
     _particleCount = (_width - 1)*(_height - 1)*4;
     _particleMax   = (_width - 1)*(_height - 1)*8;
 
@@ -65,6 +97,7 @@ Fluid::Fluid(int width, int height) : _width(width), _height(height) {
     _addSub           = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ScalarOp.vert", 0, "AddSub.frag", 2);
     _scaledAdd        = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ScalarOp.vert", 0, "ScaledAdd.frag", 1);
     _advect           = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "Advect.frag", 1);
+    _macCormack       = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "MacCormack.frag", 1);
     _precon           = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "ApplyPreconditioner.frag", 2);
     _applyP           = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "ApplyPressure.frag", 2);
     _buildPRhs        = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "BuildPressureRhs.frag", 1);
@@ -88,24 +121,52 @@ Fluid::Fluid(int width, int height) : _width(width), _height(height) {
     _inflow           = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "Inflow.frag", 1);
     _particleAdvect   = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ParticleQuad.vert", 0, "ParticleAdvect.frag", 1);
     _particleFromGrid = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ParticleQuad.vert", 0, "ParticleFromGrid.frag", 1);
+    _particleFromGridAffine = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ParticleQuad.vert", 0, "ParticleFromGridAffine.frag", 2);
     _fastSweep        = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ParticleQuad.vert", 0, "FastSweep.frag", 0);
     _particleRender   = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ParticleRender.vert", 0, "ParticleRender.frag", 1);
     _particleHisto    = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ParticleCount.vert", 0, 0, 0);
     _particleBucket   = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ParticleBucket.vert", 0, 0, 0);
+    _stableBucket     = new Shader("../src/shaders/Fluid/", "Preamble.txt", "ParticleBucketStable.vert", 0, 0, 0);
     _spawnInflow      = new Shader("../src/shaders/Fluid/", "Preamble.txt", "SpawnInflowParticles.vert", 0, 0, 0);
-
-    _blackPbo = new BufferObject(PIXEL_UNPACK_BUFFER, _tWidth*_tHeight*sizeof(float));
-    _blackPbo->bind();
-    _blackPbo->map();
-    memset(_blackPbo->data(), 0, _tWidth*_tHeight*sizeof(float));
-    _blackPbo->unmap();
-    _blackPbo->unbind();
+    _obstacle         = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "Obstacle.frag", 1);
+    _buildTiles       = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "BuildTiles.frag", 1);
+    _markTiles        = new Shader("../src/shaders/Fluid/", "Preamble.txt", "Fluid.vert", 0, "MarkTiles.frag", 1);
+    _compactTiles     = new Shader("../src/shaders/Fluid/", "Preamble.txt", "CompactTiles.vert", 0, 0, 0);
+    _cgInit           = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "CgInit.comp");
+    _cgMatVec         = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "MatVecProduct.comp");
+    _cgUpdate         = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "CgUpdate.comp");
+    _cgDirection      = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "CgDirection.comp");
+    _cgReduce         = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "Reduce.comp");
+    _pipelinedMatVec  = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "PipelinedMatVec.comp");
+#if USE_MIC_PRECONDITIONER
+    _buildPrecon      = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "BuildPreconditioner.comp");
+    _pipelinedPrecon  = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "PipelinedPrecondition.comp");
+#endif
+    _pipelinedUpdate  = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "PipelinedUpdate.comp");
+    _pipelinedReduce  = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "PipelinedReduce.comp");
+    _particleKeys     = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "ParticleKeys.comp");
+    _radixBlockSort   = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "RadixBlockSort.comp");
+    _radixScatter     = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "RadixScatter.comp");
+    _scan             = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "Scan.comp");
+    _scanAdd          = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "ScanAdd.comp");
+    _cellRanges       = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "CellRanges.comp");
+    _sortedBucket     = new Shader("../src/shaders/Fluid/", "ComputePreamble.txt", "SortedBucket.comp");
+
+    _stepConstants = new StreamBuffer(UNIFORM_BUFFER, 4*1024);
+    setStepConstants(0.0f);
 
     for (int i = 0; i < 2; i++) {
         _dotPTransfer[i] = new Texture(TEXTURE_2D, 2, 2);
         _dotPTransfer[i]->setFormat(TEXEL_FLOAT, 1, 4);
         _dotPTransfer[i]->init();
     }
+    _maxVelocity = new AsyncReadback(4*sizeof(float));
+    _heatResidual = new AsyncReadback(4*sizeof(float));
+    _pressureResidual = new AsyncReadback(4*sizeof(float));
+    _edits = new EditQueue();
+
+    Inflow inflow = {0.88f, 0.055f, 0.4f, 0.01f, 200.0f, 5000*_width/1920};
+    _inflows.push_back(inflow);
 
     _histoLevels = 1;
     for (int t = max(_width, _height); t > 1; t = (t - 1)/2 + 1, _histoLevels++);
@@ -119,16 +180,68 @@ Fluid::Fluid(int width, int height) : _width(width), _height(height) {
         _histoCount[i] = new Texture(TEXTURE_2D, w, h);
         _histoCount[i]->setFormat(TEXEL_UNSIGNED, 1, 4);
         _histoCount[i]->init();
-        _histoCount[i]->copyPbo(*_blackPbo);
+        _histoCount[i]->clear();
         _histoIndex[i] = new Texture(TEXTURE_2D, w, h);
         _histoIndex[i]->setFormat(TEXEL_UNSIGNED, 1, 4);
         _histoIndex[i]->init();
-        _histoIndex[i]->copyPbo(*_blackPbo);
+        _histoIndex[i]->clear();
 
         w = (w - 1)/2 + 1;
         h = (h - 1)/2 + 1;
     }
 
+    for (int i = 0; i < 2; i++) {
+        _bucketKeys[i] = new Texture(TEXTURE_2D, _width, _height);
+        _bucketKeys[i]->setFormat(TEXEL_UNSIGNED, 1, 4);
+        _bucketKeys[i]->init();
+        _bucketKeys[i]->clear();
+    }
+
+    _tilesX = (_width  - 1)/TileSize + 1;
+    _tilesY = (_height - 1)/TileSize + 1;
+    /* The tile mask is built on the first step, with or without obstacles */
+    _solidDirty = true;
+    _deterministic = false;
+    _trackTiles = false;
+
+    _solid = new Texture(TEXTURE_2D, _tWidth, _tHeight);
+    _solid->setFormat(TEXEL_FLOAT, 1, 1);
+    _solid->init();
+    _solid->clear();
+
+    _tileMask = new Texture(TEXTURE_2D, _tilesX, _tilesY);
+    _tileMask->setFormat(TEXEL_FLOAT, 1, 1);
+    _tileMask->init();
+
+    _tileRaw = new Texture(TEXTURE_2D, _tilesX, _tilesY);
+    _tileRaw->setFormat(TEXEL_FLOAT, 1, 1);
+    _tileRaw->init();
+
+    for (int i = 0; i < 2; i++) {
+        _tileActivity[i] = new Texture(TEXTURE_2D, _tilesX, _tilesY);
+        _tileActivity[i]->setFormat(TEXEL_FLOAT, 1, 1);
+        _tileActivity[i]->init();
+        _tileActivity[i]->clear();
+    }
+
+    for (int i = 0; i < TileListCount; i++) {
+        _tileBuffer[i] = new BufferObject(ARRAY_BUFFER, _tilesX*_tilesY*2*sizeof(uint16_t));
+        _tileList[i] = new Texture(TEXTURE_BUFFER, _tilesX*_tilesY);
+        _tileList[i]->setFormat(TEXEL_UNSIGNED, 2, 2);
+        _tileList[i]->init(_tileBuffer[i]->glName());
+    }
+
+    _tileCommands = new BufferObject(DRAW_INDIRECT_BUFFER);
+    _tileCommands->bind();
+    _tileCommands->copyData((void *)emptyTileCommands, sizeof(emptyTileCommands), GL_DYNAMIC_DRAW);
+    _tileCommands->unbind();
+    _partials = new BufferObject(SHADER_STORAGE_BUFFER, 2*_tilesX*_tilesY*sizeof(float));
+    _scalars  = new BufferObject(SHADER_STORAGE_BUFFER, ScalarCount*sizeof(float));
+
+    _tileCounts = new Texture(TEXTURE_BUFFER, TileListCount*4);
+    _tileCounts->setFormat(TEXEL_UNSIGNED, 1, 4);
+    _tileCounts->init(_tileCommands->glName());
+
     Texture **ts[] = {
 		&_u, &_v, &_d, &_t, &_aDiag, &_aPlusX, &_aPlusY, &_p, &_r, &_z, &_s,
 		&_tmp1, &_tmp2, &_uTmp, &_vTmp, &_tTmp, &_dTmp
@@ -137,9 +250,14 @@ Fluid::Fluid(int width, int height) : _width(width), _height(height) {
         *(ts[i]) = new Texture(TEXTURE_2D, _tWidth, _tHeight);
         (*(ts[i]))->setFormat(TEXEL_FLOAT, 1, 4);
         (*(ts[i]))->init();
-        (*(ts[i]))->copyPbo(*_blackPbo);
+        (*(ts[i]))->clear();
     }
 
+    _preconDiag = new Texture(TEXTURE_2D, _tWidth, _tHeight);
+    _preconDiag->setFormat(TEXEL_FLOAT, 1, 4);
+    _preconDiag->init();
+    _preconDiag->clear();
+
     _particlePos = new Texture(TEXTURE_2D, _pTexW, _pTexH);
     _particlePos->setFormat(TEXEL_FLOAT, 2, 4);
     _particlePos->init();
@@ -154,36 +272,117 @@ Fluid::Fluid(int width, int height) : _width(width), _height(height) {
     _particleQTmp->setFormat(TEXEL_FLOAT, 4, 4);
     _particleQTmp->init();
 
+    _particleGrad = _particleGradTmp = 0;
+    for (int i = 0; i < 2; i++)
+        _sortKeys[i] = _sortValues[i] = 0;
+    _digitCounts = _digitStarts = 0;
+
     printf("Texture memory usage: %dmb\n", (int)(Texture::memoryUsage()/(1024*1024)));
 }
 
-void Fluid::makePreamble(const char *src, const char *dst) {
-    static char text[4*1024], preamble[4*1024];
+void Fluid::setStepConstants(float timestep) {
+    _constants.timestep      = timestep;
+    _constants.invHx         = 1.0f/_hX;
+    _constants.pressureScale = timestep/_density*1.0f/_hX;
+    _constants.heatScale     = timestep*_diffusion*1.0f/(_hX*_hX);
+    _constants.curlScale     = 0.5f/_hX;
+
+    uploadStepConstants();
+}
+
+void Fluid::uploadStepConstants() {
+    _constants.pointInfo[0] = _pTexW;
+    _constants.pointInfo[1] = _particleCount;
+
+    GLintptr offset;
+    void *dst = _stepConstants->allocate(sizeof(StepConstants), offset);
+    memcpy(dst, &_constants, sizeof(StepConstants));
+    _stepConstants->buffer().bindIndexedRange(StepConstantsBinding, offset, sizeof(StepConstants));
+}
+
+void Fluid::makePreamble(const char *src, const char *computeSrc, const char *dst, const char *computeDst) {
+    /* Room for either source plus the generated defines */
+    static char text[8*1024], preamble[10*1024], compute[20*1024];
 
     FILE* fp;
     fopen_s(&fp, src, "rb");
-    fread(text, 1, fsize(fp), fp);
+    int size = fsize(fp);
+    ASSERT(size < (int)sizeof(text), "Preamble source '%s' does not fit the buffer\n", src);
+    fread(text, 1, size, fp);
+    text[size] = '\0';
     fclose(fp);
 
-    sprintf_s(preamble,
+    int length = _snprintf_s(preamble, _TRUNCATE,
         "%s\n"
         "#define WIDTH          %d\n"
         "#define HEIGHT         %d\n"
         "#define T_WIDTH        %d\n"
         "#define T_HEIGHT       %d\n"
+        "#define TILE_SIZE      %d\n"
+        "layout(std140, binding = %d) uniform StepConstants {\n"
+        "    ivec2 PointInfo;\n"
+        "    float Timestep;\n"
+        "    float InvHx;\n"
+        "    float PressureScale;\n"
+        "    float HeatScale;\n"
+        "    float CurlScale;\n"
+        "};\n"
+        "uniform sampler2D Solid;\n"
+        "bool solidCell(ivec2 coord) {\n"
+        "    return texelFetch(Solid, coord, 0).r != 0.0;\n"
+        "}\n"
         "bool fluidCell(ivec2 coord) {\n"
-        "    return coord.x >= 0 && coord.y >= 0 && coord.x < WIDTH - 1 && coord.y < HEIGHT - 1;\n"
+        "    return coord.x >= 0 && coord.y >= 0 && coord.x < WIDTH - 1 && coord.y < HEIGHT - 1 && !solidCell(coord);\n"
         "}\n",
         text,
         _width,
         _height,
         _tWidth,
-        _tHeight
+        _tHeight,
+        TileSize,
+        StepConstantsBinding
     );
 
+    ASSERT(length >= 0, "Generated preamble does not fit the buffer\n");
+
     fopen_s(&fp, dst, "wb");
     fwrite(preamble, 1, strlen(preamble), fp);
     fclose(fp);
+
+    fp = fopen(computeSrc, "rb");
+    size = fsize(fp);
+    ASSERT(size < (int)sizeof(text), "Preamble source '%s' does not fit the buffer\n", computeSrc);
+    fread(text, 1, size, fp);
+    text[size] = '\0';
+    fclose(fp);
+
+    /* Compute kernels run one workgroup per tile and skip inactive ones */
+    length = _snprintf_s(compute, _TRUNCATE,
+        "%s"
+        "#define GROUP_SIZE     %d\n"
+        "#define DOT_SLOT       %d\n"
+        "#define GAMMA_SLOT     %d\n"
+        "#define ALPHA_SLOT     %d\n"
+        "#define BETA_SLOT      %d\n"
+        "#define MIC_PRECONDITIONER %d\n"
+        "#define PRECON_RADIUS  %d\n"
+        "%s\n",
+        preamble,
+        TileSize*TileSize,
+        DotSlot,
+        GammaSlot,
+        AlphaSlot,
+        BetaSlot,
+        USE_MIC_PRECONDITIONER,
+        USE_MIC_PRECONDITIONER ? 0 : 1,
+        text
+    );
+
+    ASSERT(length >= 0, "Generated compute preamble does not fit the buffer\n");
+
+    fopen_s(&fp, computeDst, "wb");
+    fwrite(compute, 1, strlen(compute), fp);
+    fclose(fp);
 }
 
 void Fluid::particleQuad(Shader & s) {
@@ -196,7 +395,7 @@ void Fluid::particleQuad(Shader & s) {
     float y1 = ((_particleCount - 1)/_pTexW + 1)*2.0f/RenderTarget::viewportH() - 1.0f;
 
     s.uniformF("QuadInfo", -1.0, -1.0, x1, y1);
-    s.uniformI("PointInfo", _pTexW, _particleCount);
+    bindSolid(s);
 
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
@@ -209,7 +408,7 @@ void Fluid::shaderLoop(Shader &s, int x, int y, int w, int h) {
     shaderQuad(s, x, y, w, h, x, y, w, h, false);
 }
 
-void Fluid::shaderQuad(Shader &s, int x, int y, int w, int h, int vx, int vy, int vw, int vh, bool filled) {
+void Fluid::shaderQuad(Shader &s, int x, int y, int w, int h, int vx, int vy, int vw, int vh, bool filled, int tiles) {
     ASSERT(RenderTarget::viewportX() == 0 &&
            RenderTarget::viewportY() == 0, "Viewport needs to be 0 aligned\n");
     ASSERT(RenderTarget::viewportW() >= x + w &&
@@ -232,15 +431,85 @@ void Fluid::shaderQuad(Shader &s, int x, int y, int w, int h, int vx, int vy, in
 
     s.uniformF("QuadInfo", x0, y0, x1, y1);
     s.uniformF("TexelInfo", (float)vx, (float)vy, (float)(vx + vw), (float)(vy + vh) );
+    s.uniformI("Tiled", tiles >= 0);
+    bindSolid(s);
+
+    if (tiles >= 0) {
+        _tileList[tiles]->bindAny();
+        s.uniformI("Tiles", _tileList[tiles]->boundUnit());
+
+        _tileCommands->bind();
+        glDrawArraysIndirect(GL_TRIANGLE_FAN, (const void *)(tiles*4*sizeof(GLuint)));
+        _tileCommands->unbind();
+    } else
+        glDrawArrays((filled ? GL_TRIANGLE_FAN : GL_LINE_LOOP), 0, 4);
+}
+
+/* Draws a grid pass over [0, w) x [0, h), restricted to the tiles that
+ * updateTiles marked active this step. Everything outside holds the resting
+ * state (zero, ambient temperature in _t), so full-domain reductions and
+ * neighbour reads across the tile boundary stay valid. */
+void Fluid::shaderGrid(Shader &s, int w, int h) {
+    shaderQuad(s, 0, 0, w, h, 0, 0, w, h, true, ActiveTiles);
+}
+
+void Fluid::fillTiles(Texture &dst, float value, TileList list) {
+    _fbos->bind(dst);
+    _set->bind();
+    _set->uniformF("Value", value);
+    shaderQuad(*_set, 0, 0, _tWidth, _tHeight, 0, 0, _tWidth, _tHeight, true, list);
+}
 
-    glDrawArrays((filled ? GL_TRIANGLE_FAN : GL_LINE_LOOP), 0, 4);
+void Fluid::bindSolid(Shader &s) {
+    _solid->bindAny();
+    _tileList[ActiveTiles]->bindAny();
+    s.uniformI("Solid", _solid->boundUnit());
+    s.uniformI("Tiles", _tileList[ActiveTiles]->boundUnit());
+}
+
+void Fluid::bindMatrix(Shader &s) {
+    _aDiag     ->bindAny();
+    _aPlusX    ->bindAny();
+    _aPlusY    ->bindAny();
+    _preconDiag->bindAny();
+
+    s.uniformI("ADiag",      _aDiag     ->boundUnit());
+    s.uniformI("APlusX",     _aPlusX    ->boundUnit());
+    s.uniformI("APlusY",     _aPlusY    ->boundUnit());
+    s.uniformI("PreconDiag", _preconDiag->boundUnit());
+}
+
+void Fluid::dispatchTiles(Shader &s) {
+    _tileActivity[0]->bindAny();
+    s.uniformI("ActiveTiles", _tileActivity[0]->boundUnit());
+    bindSolid(s);
+    bindMatrix(s);
+
+    s.dispatch(_tilesX, _tilesY);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void Fluid::reduceTiles(int dst) {
+    _cgReduce->bind();
+    _cgReduce->uniformI("Count", _tilesX*_tilesY);
+    _cgReduce->uniformI("Dst", dst);
+    _cgReduce->dispatch(1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Fluid::reducePipelined(bool first) {
+    _pipelinedReduce->bind();
+    _pipelinedReduce->uniformI("Count", _tilesX*_tilesY);
+    _pipelinedReduce->uniformI("First", first);
+    _pipelinedReduce->dispatch(1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void Fluid::parallelReduce(Shader &s, Texture &src, Texture &target, int subdiv) {
     src.bindAny();
     _tmp2->bindAny();
 
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(*_tmp2));
+    _fbos->bind(*_tmp2);
 
     s.bind();
     s.uniformI("R", src.boundUnit());
@@ -254,7 +523,7 @@ void Fluid::parallelReduce(Shader &s, Texture &src, Texture &target, int subdiv)
         h = (innerH + subdiv - 1) & (~(subdiv - 1));
 
         if (w == subdiv && h == subdiv) {
-            _rt->selectAttachmentList(1, _rt->attachTextureAny(target));
+            _fbos->bind(target);
             writeOffset = 0;
         }
 
@@ -284,8 +553,7 @@ float Fluid::maxReduce(Texture &src, Texture &target) {
     parallelReduce(*_maxReduce, src, target, 2);
 
     float lastStep[4];
-    target.bindAny();
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, lastStep);
+    target.read(lastStep);
 
     return max(lastStep[0], max(lastStep[1], max(lastStep[2], lastStep[3])));
 }
@@ -296,16 +564,14 @@ void Fluid::matVecProduct(Texture &aDiag, Texture &aPlusX, Texture &aPlusY, Text
     aPlusY.bindAny();
     b.bindAny();
 
-    RtAttachment att1 = _rt->attachTextureAny(result);
-    RtAttachment att2 = _rt->attachTextureAny(ab);
-    _rt->selectAttachmentList(2, att1, att2);
+    _fbos->bind(result, ab);
 
     _matVecProduct->bind();
     _matVecProduct->uniformI("ADiag",  aDiag .boundUnit());
     _matVecProduct->uniformI("APlusX", aPlusX.boundUnit());
     _matVecProduct->uniformI("APlusY", aPlusY.boundUnit());
     _matVecProduct->uniformI("B",      b     .boundUnit());
-    shaderQuad(*_matVecProduct, 0, 0, _width - 1, _height - 1);
+    shaderGrid(*_matVecProduct, _width - 1, _height - 1);
 }
 
 void Fluid::addSub(Texture &subA, Texture &subB, Texture &addA, Texture &addB, Texture &dstSub, Texture &dstAdd, Texture &alpha, Texture &beta) {
@@ -316,9 +582,7 @@ void Fluid::addSub(Texture &subA, Texture &subB, Texture &addA, Texture &addB, T
     alpha.bindAny();
     beta.bindAny();
 
-    RtAttachment a1 = _rt->attachTextureAny(dstSub);
-    RtAttachment a2 = _rt->attachTextureAny(dstAdd);
-    _rt->selectAttachmentList(2, a1, a2);
+    _fbos->bind(dstSub, dstAdd);
 
     _addSub->bind();
     _addSub->uniformI("SrcSubA", subA.boundUnit());
@@ -327,7 +591,7 @@ void Fluid::addSub(Texture &subA, Texture &subB, Texture &addA, Texture &addB, T
     _addSub->uniformI("SrcAddB", addB.boundUnit());
     _addSub->uniformI("Alpha",  alpha.boundUnit());
     _addSub->uniformI("Beta",    beta.boundUnit());
-    shaderQuad(*_addSub, 0, 0, _width - 1, _height - 1);
+    shaderGrid(*_addSub, _width - 1, _height - 1);
 }
 
 void Fluid::scaledAdd(Texture &addA, Texture &addB, Texture &dst, Texture &alpha, Texture &beta) {
@@ -336,137 +600,181 @@ void Fluid::scaledAdd(Texture &addA, Texture &addB, Texture &dst, Texture &alpha
     alpha.bindAny();
     beta.bindAny();
 
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(dst));
+    _fbos->bind(dst);
 
     _scaledAdd->bind();
     _scaledAdd->uniformI("SrcAddA", addA.boundUnit());
     _scaledAdd->uniformI("SrcAddB", addB.boundUnit());
     _scaledAdd->uniformI("Alpha",  alpha.boundUnit());
     _scaledAdd->uniformI("Beta",    beta.boundUnit());
-    shaderQuad(*_scaledAdd, 0, 0, _width - 1, _height - 1);
+    shaderGrid(*_scaledAdd, _width - 1, _height - 1);
 }
 
-void Fluid::advect(Texture &src, Texture &dst, float timestep, float offX, float offY, int w, int h) {
+/* Traces back along the flow for direction 1 and forward for -1 */
+void Fluid::advect(Texture &src, Texture &dst, float offX, float offY, int w, int h, float direction) {
     src.bindAny();
     _u->bindAny();
     _v->bindAny();
 
-    RtAttachment att = _rt->attachTextureAny(dst);
-    _rt->selectAttachmentList(1, att);
+    _fbos->bind(dst);
 
     _advect->bind();
     _advect->uniformI("D", src.boundUnit());
     _advect->uniformI("U", _u->boundUnit());
     _advect->uniformI("V", _v->boundUnit());
     _advect->uniformI("Limits", w - 1, h - 1);
-    _advect->uniformF("Timestep", timestep);
     _advect->uniformF("Offset", offX, offY);
-    _advect->uniformF("InvHx", 1.0f/_hX);
-    shaderQuad(*_advect, 0, 0, w, h);
+    _advect->uniformF("Direction", direction);
+    shaderGrid(*_advect, w, h);
+}
+
+void Fluid::macCormack(Texture &src, Texture &forward, Texture &backward, Texture &dst, float offX, float offY, int w, int h) {
+    src.bindAny();
+    forward.bindAny();
+    backward.bindAny();
+    _u->bindAny();
+    _v->bindAny();
+
+    _fbos->bind(dst);
+
+    _macCormack->bind();
+    _macCormack->uniformI("D", src.boundUnit());
+    _macCormack->uniformI("Forward", forward.boundUnit());
+    _macCormack->uniformI("Backward", backward.boundUnit());
+    _macCormack->uniformI("U", _u->boundUnit());
+    _macCormack->uniformI("V", _v->boundUnit());
+    _macCormack->uniformI("Limits", w - 1, h - 1);
+    _macCormack->uniformF("Offset", offX, offY);
+    shaderGrid(*_macCormack, w, h);
+}
+
+/* Advects all four fields by the current velocity. The results go to
+ * scratch textures first, since the velocity must stay put until the last
+ * field is done. The scratch is picked so that none of it needs clearing:
+ * _dTmp and _tTmp are only read back by the particle transfer, update()
+ * clears _p, and addVorticity overwrites _s before it is read. _z and _r
+ * stay zero from the end of the last step */
+void Fluid::advectGrid() {
+    Texture *qs[]  = {_d, _t, _u, _v};
+    Texture *dst[] = {_dTmp, _tTmp, _p, _s};
+    const float offX[] = {0.0f, 0.0f, 0.0f, 0.5f};
+    const float offY[] = {0.0f, 0.0f, 0.5f, 0.0f};
+
+    for (int i = 0; i < 4; i++) {
+        if (_advection == ADVECT_MACCORMACK) {
+            advect(*qs[i], *_tmp1, offX[i], offY[i], _width - 1, _height - 1, 1.0f);
+            advect(*_tmp1, *_tmp2, offX[i], offY[i], _width - 1, _height - 1, -1.0f);
+            macCormack(*qs[i], *_tmp1, *_tmp2, *dst[i], offX[i], offY[i], _width - 1, _height - 1);
+        } else
+            advect(*qs[i], *dst[i], offX[i], offY[i], _width - 1, _height - 1, 1.0f);
+    }
+
+    swap(_d, _dTmp);
+    swap(_t, _tTmp);
+    swap(_u, _p);
+    swap(_v, _s);
 }
 
 void Fluid::buildPRhs(Texture &rhs) {
     _u->bindAny();
     _v->bindAny();
 
-    RtAttachment dst = _rt->attachTextureAny(rhs);
-    _rt->selectAttachmentList(1, dst);
+    _fbos->bind(rhs);
 
     _buildPRhs->bind();
     _buildPRhs->uniformI("U", _u->boundUnit());
     _buildPRhs->uniformI("V", _v->boundUnit());
-    _buildPRhs->uniformF("InvHx", 1.0f);
-    shaderQuad(*_buildPRhs, 0, 0, _width - 1, _height - 1);
+    shaderGrid(*_buildPRhs, _width - 1, _height - 1);
 }
 
-void Fluid::buildPMat(float timestep) {
-    RtAttachment a1 = _rt->attachTextureAny(*_aDiag);
-    RtAttachment a2 = _rt->attachTextureAny(*_aPlusX);
-    RtAttachment a3 = _rt->attachTextureAny(*_aPlusY);
-
-    _rt->selectAttachmentList(3, a1, a2, a3);
+void Fluid::buildPMat() {
+    _fbos->bind(*_aDiag, *_aPlusX, *_aPlusY);
 
     _buildPMat->bind();
-    _buildPMat->uniformF("Scale", timestep/_density*1.0f/_hX);
-    shaderQuad(*_buildPMat, 0, 0, _width - 1, _height - 1);
-}
+    shaderGrid(*_buildPMat, _width - 1, _height - 1);
 
-void Fluid::buildHMat(float timestep) {
-    RtAttachment a1 = _rt->attachTextureAny(*_aDiag);
-    RtAttachment a2 = _rt->attachTextureAny(*_aPlusX);
-    RtAttachment a3 = _rt->attachTextureAny(*_aPlusY);
+    buildPreconditioner();
+}
 
-    _rt->selectAttachmentList(3, a1, a2, a3);
+void Fluid::buildHMat() {
+    _fbos->bind(*_aDiag, *_aPlusX, *_aPlusY);
 
     _buildHMat->bind();
-    _buildHMat->uniformF("Scale", timestep*_diffusion*1.0f/(_hX*_hX));
-    shaderQuad(*_buildHMat, 0, 0, _width - 1, _height - 1);
+    _tileActivity[0]->bindAny();
+    _buildHMat->uniformI("Active", _tileActivity[0]->boundUnit());
+    shaderGrid(*_buildHMat, _width - 1, _height - 1);
+
+    buildPreconditioner();
+}
+
+void Fluid::buildPreconditioner() {
+#if USE_COMPUTE_CG && USE_MIC_PRECONDITIONER
+    _preconDiag->bindImage(0, false, true);
+
+    _buildPrecon->bind();
+    _buildPrecon->uniformI("Factor", 0);
+    dispatchTiles(*_buildPrecon);
+#endif
 }
 
 void Fluid::buildVorticity(Texture &dst) {
     _u->bindAny();
     _v->bindAny();
 
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(dst));
+    _fbos->bind(dst);
 
     _buildVorticity->bind();
     _buildVorticity->uniformI("U", _u->boundUnit());
     _buildVorticity->uniformI("V", _v->boundUnit());
-    _buildVorticity->uniformF("Scale", 0.5f/_hX);
-    shaderQuad(*_buildVorticity, 0, 0, _width, _height);
+    shaderGrid(*_buildVorticity, _width, _height);
 }
 
 void Fluid::confineVorticity(float epsilon, Texture &src, Texture &dstU, Texture &dstV) {
     src.bindAny();
 
-    RtAttachment att1 = _rt->attachTextureAny(dstU);
-    RtAttachment att2 = _rt->attachTextureAny(dstV);
-    _rt->selectAttachmentList(2, att1, att2);
+    _fbos->bind(dstU, dstV);
 
     _confineV->bind();
     _confineV->uniformI("W", src.boundUnit());
-    _confineV->uniformF("Scale", 0.5f/_hX);
     _confineV->uniformF("Hx", _hX);
     _confineV->uniformF("Epsilon", epsilon);
-    shaderQuad(*_confineV, 0, 0, _width, _height);
+    shaderGrid(*_confineV, _width, _height);
 }
 
-void Fluid::addVorticity(float timestep, Texture &srcU, Texture &srcV, Texture &dstU, Texture &dstV) {
+void Fluid::addVorticity(Texture &srcU, Texture &srcV, Texture &dstU, Texture &dstV) {
     srcU.bindAny();
     srcV.bindAny();
     _u->bindAny();
     _v->bindAny();
 
-    RtAttachment att1 = _rt->attachTextureAny(dstU);
-    RtAttachment att2 = _rt->attachTextureAny(dstV);
-    _rt->selectAttachmentList(2, att1, att2);
+    _fbos->bind(dstU, dstV);
 
     _addVorticity->bind();
     _addVorticity->uniformI("WU", srcU.boundUnit());
     _addVorticity->uniformI("WV", srcV.boundUnit());
     _addVorticity->uniformI("U",   _u->boundUnit());
     _addVorticity->uniformI("V",   _v->boundUnit());
-    _addVorticity->uniformF("Timestep", timestep);
-    shaderQuad(*_addVorticity, 0, 0, _width - 1, _height - 1);
+    shaderGrid(*_addVorticity, _width - 1, _height - 1);
 }
 
-void Fluid::addBuoyancy(float timestep, Texture &dstV) {
+void Fluid::addBuoyancy(Texture &dstV) {
     _t->bindAny();
     _v->bindAny();
 
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(dstV));
+    _fbos->bind(dstV);
 
     _addBuoyancy->bind();
     _addBuoyancy->uniformI("T", _t->boundUnit());
     _addBuoyancy->uniformI("V", _v->boundUnit());
-    _addBuoyancy->uniformF("Timestep", timestep);
     _addBuoyancy->uniformF("G", _gravity);
     _addBuoyancy->uniformF("Density", _density);
     _addBuoyancy->uniformF("TAmb", _tAmb);
-    shaderQuad(*_addBuoyancy, 0, 0, _width - 1, _height);
+    shaderGrid(*_addBuoyancy, _width - 1, _height);
 }
 
-int Fluid::addInflow(float x, float y, float w, float h, int pAmount, const Vec4 &qMin, const Vec4 &qVal) {
+/* Spawns up to pAmount particles after the spawned ones already added this
+ * step, which are not yet counted in _particleCount */
+int Fluid::addInflow(float x, float y, float w, float h, int pAmount, int spawned, const Vec4 &qMin, const Vec4 &qVal) {
 	x /= _hX;
 	y /= _hX;
 	w /= _hX;
@@ -476,7 +784,7 @@ int Fluid::addInflow(float x, float y, float w, float h, int pAmount, const Vec4
 
     _inflow->bind();
     for (int i = 0; i < 4; i++) {
-        _rt->selectAttachmentList(1, _rt->attachTextureAny(*qs[i]));
+        _fbos->bind(*qs[i]);
         qs[i]->bindAny();
         _inflow->uniformI("Source", qs[i]->boundUnit());
         _inflow->uniformF("Value", qVal.a[i]);
@@ -486,7 +794,7 @@ int Fluid::addInflow(float x, float y, float w, float h, int pAmount, const Vec4
 
     glTextureBarrierNV();
 
-    int pAdd = min(_particleMax - _particleCount, pAmount);
+    int pAdd = min(_particleMax - _particleCount - spawned, pAmount);
 
     if (!pAdd)
         return 0;
@@ -496,60 +804,88 @@ int Fluid::addInflow(float x, float y, float w, float h, int pAmount, const Vec4
     _spawnInflow->bind();
     _spawnInflow->uniformI("ResultP", 0);
     _spawnInflow->uniformI("ResultQ", 1);
-    _spawnInflow->uniformI("PointInfo", _pTexW, _particleCount);
+    _spawnInflow->uniformI("Affine", _transfer == TRANSFER_APIC);
+    if (_transfer == TRANSFER_APIC) {
+        _particleGrad->bindImage(2, false);
+        _spawnInflow->uniformI("ResultG", 2);
+    }
     _spawnInflow->uniformF("QuadInfo", x, y, w - 1, h - 1);
     _spawnInflow->uniformF("QMin", qMin);
     _spawnInflow->uniformF("QValue", qVal);
-    glDrawArrays(GL_POINTS, _particleCount, pAdd);
+    bindSolid(*_spawnInflow);
+    glDrawArrays(GL_POINTS, _particleCount + spawned, pAdd);
     glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
 
     return pAdd;
 }
 
-void Fluid::applyPressure(Texture &p, Texture &dstU, Texture &dstV, float timestep) {
+void Fluid::applyPressure(Texture &p, Texture &dstU, Texture &dstV) {
     _u->bindAny();
     _v->bindAny();
     p.bindAny();
 
-    RtAttachment a1 = _rt->attachTextureAny(dstU);
-    RtAttachment a2 = _rt->attachTextureAny(dstV);
-    _rt->selectAttachmentList(2, a1, a2);
+    _fbos->bind(dstU, dstV);
 
     _applyP->bind();
     _applyP->uniformI("U", _u->boundUnit());
     _applyP->uniformI("V", _v->boundUnit());
     _applyP->uniformI("P",  p.boundUnit());
-    _applyP->uniformF("Scale", timestep/_density*1.0f/_hX);
-    shaderQuad(*_applyP, 0, 0, _width, _height);
+    shaderGrid(*_applyP, _width, _height);
 }
 
 void Fluid::applyPreconditioner(Texture &r, Texture &z, Texture &ab) {
     r.bindAny();
 
-    RtAttachment att1 = _rt->attachTextureAny(z);
-    RtAttachment att2 = _rt->attachTextureAny(ab);
-    _rt->selectAttachmentList(2, att1, att2);
+    _fbos->bind(z, ab);
 
     _precon->bind();
     _precon->uniformI("R", r.boundUnit());
-    shaderQuad(*_precon, 0, 0, _width - 1, _height - 1);
+    shaderGrid(*_precon, _width - 1, _height - 1);
 }
 
 void Fluid::calcVelocity(Texture &target) {
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(target));
+    _fbos->bind(target);
     _u->bindAny();
     _v->bindAny();
     _calcVelocity->bind();
     _calcVelocity->uniformI("U", _u->boundUnit());
     _calcVelocity->uniformI("V", _v->boundUnit());
-    shaderQuad(*_calcVelocity, 0, 0, _width - 1, _height - 1);
+    shaderGrid(*_calcVelocity, _width - 1, _height - 1);
+}
+
+void Fluid::adaptIterations(int &iters, float residual) {
+    fflush(stdout);
+    if (residual > 1e-2)
+        iters = min(iters + 10, 4000);
+    else {
+        iters = max(iters - 1, 100*_width/1920);
+        printf("Residual error: %f, iters %d\n", residual, iters);
+    }
+}
+
+/* Reduces the residual of the solve that just finished and reads it back
+ * without waiting for it. The iteration count adapts once the result has
+ * arrived, a frame or so later. Only one check per solve is in flight at a
+ * time, so the readback never has to wait for a free region */
+void Fluid::checkResidual(int &iters, AsyncReadback &residual, Texture &target) {
+    if (residual.pending()) {
+        residual.poll();
+        if (residual.pending())
+            return;
+
+        const float *lastCheck = (const float *)residual.latest();
+        adaptIterations(iters, max(lastCheck[0], max(lastCheck[1], max(lastCheck[2], lastCheck[3]))));
+    }
+
+    parallelReduce(*_maxReduce, *_r, target, 2);
+    residual.readTexture(target, GL_RED, GL_FLOAT);
 }
 
-void Fluid::conjugateGradients(int &iters) {
+void Fluid::fragmentConjugateGradients(int &iters, AsyncReadback &residual) {
     Texture *sigmaTex = _dotPTransfer[0];
     Texture *sigmaNTex = _dotPTransfer[1];
 
-    clear(*_p);
+    _p->clear();
     applyPreconditioner(*_r, *_z, *_tmp1);
     copy(*_s, *_z);
     addReduce(*_tmp1, *sigmaTex);
@@ -568,33 +904,187 @@ void Fluid::conjugateGradients(int &iters) {
         glTextureBarrierNV();
 
         swap(sigmaTex, sigmaNTex);
+    }
 
-        if (i == iters - 1) {
-            float residual = maxReduce(*_r, *sigmaNTex);
-            fflush(stdout);
-            if (residual > 1e-2)
-                iters = min(iters + 10, 4000);
-            else {
-                iters = max(iters - 1, 100*_width/1920);
-                printf("Residual error: %f, iters %d\n", residual, iters);
-            }
+    checkResidual(iters, residual, *sigmaNTex);
+}
+
+/* Same iteration as the fragment path in three tile kernels: the matrix
+ * product, the alpha update fused with the preconditioner and the search
+ * direction update. Dot products are summed per tile and then by a single
+ * workgroup, so the scalars never leave the GPU. */
+void Fluid::computeConjugateGradients(int &iters, AsyncReadback &residual) {
+    int sigma = SigmaSlot0, sigmaN = SigmaSlot1;
+    Texture *r = _r, *rNext = _tmp2;
+
+    _p->clear();
+    /* Skipped tiles keep whatever the last reduction left in _tmp2, which
+     * would show up in the residual */
+    rNext->clear();
+
+    _partials->bindIndexed(0);
+    _scalars->bindIndexed(1);
+
+    _p->bindImage(0);
+    _z->bindImage(2);
+    _s->bindImage(3);
+    _tmp1->bindImage(4);
+    r->bindImage(1, true, false);
+
+    _cgInit->bind();
+    _cgInit->uniformI("R", 1);
+    _cgInit->uniformI("Z", 2);
+    _cgInit->uniformI("S", 3);
+    dispatchTiles(*_cgInit);
+    reduceTiles(sigma);
+
+    _cgMatVec->bind();
+    _cgMatVec->uniformI("S", 3);
+    _cgMatVec->uniformI("Q", 4);
+
+    _cgUpdate->bind();
+    _cgUpdate->uniformI("P", 0);
+    _cgUpdate->uniformI("R", 1);
+    _cgUpdate->uniformI("Z", 2);
+    _cgUpdate->uniformI("S", 3);
+    _cgUpdate->uniformI("Q", 4);
+    _cgUpdate->uniformI("RNext", 5);
+
+    _cgDirection->bind();
+    _cgDirection->uniformI("Z", 2);
+    _cgDirection->uniformI("S", 3);
+
+    for (int i = 0; i < iters; i++) {
+        _cgMatVec->bind();
+        dispatchTiles(*_cgMatVec);
+        reduceTiles(DotSlot);
+
+        r->bindImage(1, true, false);
+        rNext->bindImage(5, false, true);
+
+        _cgUpdate->bind();
+        _cgUpdate->uniformI("Sigma", sigma);
+        dispatchTiles(*_cgUpdate);
+        reduceTiles(sigmaN);
+
+        _cgDirection->bind();
+        _cgDirection->uniformI("Sigma", sigma);
+        _cgDirection->uniformI("SigmaN", sigmaN);
+        dispatchTiles(*_cgDirection);
+
+        swap(r, rNext);
+        swap(sigma, sigmaN);
+    }
+
+    /* Hand the residual back in _r; the reduction uses _tmp2 as scratch */
+    if (r != _r) {
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        copy(*_r, *r);
+    }
+    checkResidual(iters, residual, *_dotPTransfer[0]);
+
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+/* Chronopoulos-Gear form of the same iteration. The search direction s
+ * and its image As are carried as vectors, so r.Mr and (AMr).Mr can be
+ * summed together once the next residual is known and alpha and beta
+ * follow from a single reduction. The incomplete-Poisson preconditioner
+ * is fused into the matrix product kernel with a two cell halo; the MIC
+ * tile solves cannot extend past their tile and run as a separate pass. */
+void Fluid::pipelinedMatVec() {
+#if USE_MIC_PRECONDITIONER
+    _pipelinedPrecon->bind();
+    dispatchTiles(*_pipelinedPrecon);
+#endif
+    _pipelinedMatVec->bind();
+    dispatchTiles(*_pipelinedMatVec);
+}
+
+void Fluid::pipelinedConjugateGradients(int &iters, AsyncReadback &residual) {
+    _p->clear();
+
+    _partials->bindIndexed(0);
+    _scalars->bindIndexed(1);
+
+    _p   ->bindImage(0);
+    _r   ->bindImage(1);
+    _z   ->bindImage(2);
+    _s   ->bindImage(3);
+    _tmp1->bindImage(4);
+    _tmp2->bindImage(5);
+
+#if USE_MIC_PRECONDITIONER
+    _pipelinedPrecon->bind();
+    _pipelinedPrecon->uniformI("R", 1);
+    _pipelinedPrecon->uniformI("U", 2);
+#endif
+    _pipelinedMatVec->bind();
+    _pipelinedMatVec->uniformI("R", 1);
+    _pipelinedMatVec->uniformI("U", 2);
+    _pipelinedMatVec->uniformI("W", 5);
+    pipelinedMatVec();
+    reducePipelined(true);
+
+    _pipelinedUpdate->bind();
+    _pipelinedUpdate->uniformI("X", 0);
+    _pipelinedUpdate->uniformI("R", 1);
+    _pipelinedUpdate->uniformI("U", 2);
+    _pipelinedUpdate->uniformI("P", 3);
+    _pipelinedUpdate->uniformI("S", 4);
+    _pipelinedUpdate->uniformI("W", 5);
+
+    for (int i = 0; i < iters; i++) {
+        _pipelinedUpdate->bind();
+        dispatchTiles(*_pipelinedUpdate);
+
+        if (i < iters - 1) {
+            pipelinedMatVec();
+            reducePipelined(false);
         }
     }
+
+    /* The reduction uses _tmp2 as scratch, which is free once W is no
+     * longer rebuilt */
+    checkResidual(iters, residual, *_dotPTransfer[0]);
+
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+void Fluid::conjugateGradients(int &iters, CgVariant variant, AsyncReadback &residual) {
+#if USE_COMPUTE_CG
+    if (variant == CG_PIPELINED)
+        pipelinedConjugateGradients(iters, residual);
+    else
+        computeConjugateGradients(iters, residual);
+#else
+    fragmentConjugateGradients(iters, residual);
+#endif
+}
+
+/* Binds the per-particle velocity gradients as G and, if images is set,
+ * their reordered copy as ResultG on image unit 5 */
+void Fluid::bindParticleGradients(Shader &s, bool images) {
+    _particleGrad->bindAny();
+    s.uniformI("G", _particleGrad->boundUnit());
+
+    if (images) {
+        _particleGradTmp->bindImage(5);
+        s.uniformI("ResultG", 5);
+    }
 }
 
-void Fluid::particleAdvect(float timestep) {
+void Fluid::particleAdvect() {
     _particlePos->bindAny();
     _u->bindAny();
     _v->bindAny();
 
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(*_particlePos));
+    _fbos->bind(*_particlePos);
 
     _particleAdvect->bind();
     _particleAdvect->uniformI("PPos", _particlePos->boundUnit());
     _particleAdvect->uniformI("U", _u->boundUnit());
     _particleAdvect->uniformI("V", _v->boundUnit());
-    _particleAdvect->uniformF("Timestep", timestep);
-    _particleAdvect->uniformF("InvHx", 1.0f/_hX);
     particleQuad(*_particleAdvect);
 
     glTextureBarrierNV();
@@ -606,22 +1096,47 @@ void Fluid::particleToGrid() {
     _histoCount[0]->bindAny();
     _histoIndex[0]->bindAny();
 
-    RtAttachment att1 = _rt->attachTextureAny(*_d);
-    RtAttachment att2 = _rt->attachTextureAny(*_t);
-    RtAttachment att3 = _rt->attachTextureAny(*_u);
-    RtAttachment att4 = _rt->attachTextureAny(*_v);
-    _rt->selectAttachmentList(4, att1, att2, att3, att4);
+    _fbos->bind(*_d, *_t, *_u, *_v);
 
     _particleToGrid->bind();
     _particleToGrid->uniformI("PPos", _particlePos->boundUnit());
     _particleToGrid->uniformI("Q",    _particleQ  ->boundUnit());
-    _particleToGrid->uniformI("PointInfo", _pTexW, _particleCount);
     _particleToGrid->uniformI("Counts",  _histoCount[0]->boundUnit());
     _particleToGrid->uniformI("Offsets", _histoIndex[0]->boundUnit());
-    shaderQuad(*_particleToGrid, 0, 0, _width - 1, _height - 1);
+    _particleToGrid->uniformI("Affine", _transfer == TRANSFER_APIC);
+    if (_transfer == TRANSFER_APIC)
+        bindParticleGradients(*_particleToGrid, false);
+    shaderGrid(*_particleToGrid, _width - 1, _height - 1);
 }
 
 void Fluid::particleFromGrid(Texture &q) {
+    if (_transfer == TRANSFER_APIC) {
+        q.bindAny();
+        _particlePos->bindAny();
+        _d->bindAny();
+        _t->bindAny();
+        _u->bindAny();
+        _v->bindAny();
+        _tTmp->bindAny();
+        _dTmp->bindAny();
+
+        _fbos->bind(q, *_particleGrad);
+
+        _particleFromGridAffine->bind();
+        _particleFromGridAffine->uniformI("PPos", _particlePos->boundUnit());
+        _particleFromGridAffine->uniformI("Q", q.boundUnit());
+        _particleFromGridAffine->uniformI("D", _d->boundUnit());
+        _particleFromGridAffine->uniformI("T", _t->boundUnit());
+        _particleFromGridAffine->uniformI("U", _u->boundUnit());
+        _particleFromGridAffine->uniformI("V", _v->boundUnit());
+        _particleFromGridAffine->uniformI("TOld", _tTmp->boundUnit());
+        _particleFromGridAffine->uniformI("DOld", _dTmp->boundUnit());
+        particleQuad(*_particleFromGridAffine);
+
+        glTextureBarrierNV();
+        return;
+    }
+
     q.bindAny();
     _d->bindAny();
     _t->bindAny();
@@ -633,7 +1148,7 @@ void Fluid::particleFromGrid(Texture &q) {
     _dTmp->bindAny();
     _particlePos->bindAny();
 
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(q));
+    _fbos->bind(q);
 
     _particleFromGrid->bind();
     _particleFromGrid->uniformI("PPos", _particlePos->boundUnit());
@@ -652,37 +1167,140 @@ void Fluid::particleFromGrid(Texture &q) {
 }
 
 void Fluid::particleExtrapolate(Texture &q, Texture &w) {
-    RtAttachment att1 = _rt->attachTextureAny(q);
-    RtAttachment att2 = _rt->attachTextureAny(w);
+    q.bindAny();
+    w.bindAny();
+
 
     _gather->bind();
     for (int i = 0; i < 10; i++) {
-        _rt->selectAttachmentList(1, (i & 1 ? att1 : att2));
+        _fbos->bind(i & 1 ? q : w);
         _gather->uniformI("D", (i & 1 ? w : q).boundUnit());
-        shaderQuad(*_gather, 0, 0, _width - 1, _height - 1);
+        shaderGrid(*_gather, _width - 1, _height - 1);
     }
 }
 
-void Fluid::particleCount() {
-    clear(*_histoCount[0]);
+/* Exclusive scan of a uint buffer in place. Each workgroup scans its own
+ * span, the span totals are scanned one level up and added back down */
+void Fluid::scanDigits(BufferObject &data, int count, int level) {
+    int groups = (count - 1)/SortBlockSize + 1;
+
+    data.bindIndexed(2);
+    _scanSums[level]->bindIndexed(3);
+    _scan->bind();
+    _scan->uniformI("Count", count);
+    _scan->dispatch(groups);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (groups == 1)
+        return;
+
+    scanDigits(*_scanSums[level], groups, level + 1);
+
+    data.bindIndexed(2);
+    _scanSums[level]->bindIndexed(3);
+    _scanAdd->bind();
+    _scanAdd->uniformI("Count", count);
+    _scanAdd->dispatch(groups);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+/* Least significant digit radix sort of the particles by cell, four bits
+ * per pass. Blocks sort themselves locally and only their per-digit
+ * counts go through the global scan, so the passes are free of atomics.
+ * Afterwards _bucketKeys hold the start and end of every cell's run */
+void Fluid::sortParticles() {
+    int blocks = (_particleCount - 1)/SortBlockSize + 1;
+
     _particlePos->bindAny();
-    _histoCount[0]->bindImage(0);
-    _particleHisto->bind();
-    _particleHisto->uniformI("PPos", _particlePos->boundUnit());
-    _particleHisto->uniformI("Counts", 0);
-    _particleHisto->uniformI("PointInfo", _pTexW, _particleCount);
-    glDrawArrays(GL_POINTS, 0, _particleCount);
+    _sortKeys[0]->bindIndexed(2);
+    _sortValues[0]->bindIndexed(3);
+    _particleKeys->bind();
+    _particleKeys->uniformI("PPos", _particlePos->boundUnit());
+    _particleKeys->uniformI("Sentinel", (1 << _sortBits) - 1);
+    _particleKeys->dispatch(blocks);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    for (int shift = 0; shift < _sortBits; shift += 4) {
+        _sortKeys[0]->bindIndexed(2);
+        _sortValues[0]->bindIndexed(3);
+        _digitCounts->bindIndexed(6);
+        _digitStarts->bindIndexed(7);
+        _radixBlockSort->bind();
+        _radixBlockSort->uniformI("Shift", shift);
+        _radixBlockSort->dispatch(blocks);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        scanDigits(*_digitCounts, 16*blocks, 0);
+
+        _sortKeys[0]->bindIndexed(2);
+        _sortValues[0]->bindIndexed(3);
+        _sortKeys[1]->bindIndexed(4);
+        _sortValues[1]->bindIndexed(5);
+        _digitCounts->bindIndexed(6);
+        _digitStarts->bindIndexed(7);
+        _radixScatter->bind();
+        _radixScatter->uniformI("Shift", shift);
+        _radixScatter->dispatch(blocks);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        swap(_sortKeys[0], _sortKeys[1]);
+        swap(_sortValues[0], _sortValues[1]);
+    }
+
+    _bucketKeys[0]->clear();
+    _bucketKeys[1]->clear();
+    _sortKeys[0]->bindIndexed(2);
+    _bucketKeys[0]->bindImage(3, false);
+    _bucketKeys[1]->bindImage(4, false);
+    _cellRanges->bind();
+    _cellRanges->uniformI("Starts", 3);
+    _cellRanges->uniformI("Ends", 4);
+    _cellRanges->dispatch(blocks);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void Fluid::particleCount() {
+    if (_binning == BIN_RADIX_SORT)
+        sortParticles();
+    else {
+        _histoCount[0]->clear();
+        _particlePos->bindAny();
+        _histoCount[0]->bindImage(0);
+        _particleHisto->bind();
+        _particleHisto->uniformI("PPos", _particlePos->boundUnit());
+        _particleHisto->uniformI("Counts", 0);
+        bindSolid(*_particleHisto);
+        glDrawArrays(GL_POINTS, 0, _particleCount);
+    }
 
     _histoCount[0]->bindAny();
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(*_histoCount[0]));
+    _fbos->bind(*_histoCount[0]);
     _clampCounts->bind();
     _clampCounts->uniformI("Counts", _histoCount[0]->boundUnit());
+    _clampCounts->uniformI("Range", _minPerCell, _maxPerCell);
+    _clampCounts->uniformI("Sorted", _binning == BIN_RADIX_SORT);
+    if (_binning == BIN_RADIX_SORT) {
+        _bucketKeys[0]->bindAny();
+        _bucketKeys[1]->bindAny();
+        _clampCounts->uniformI("Starts", _bucketKeys[0]->boundUnit());
+        _clampCounts->uniformI("Ends",   _bucketKeys[1]->boundUnit());
+    }
+    /* Not tiled: every cell needs a valid count header for particleBucket */
     shaderQuad(*_clampCounts, 0, 0, _width - 1, _height - 1);
     glTextureBarrierNV();
 }
 
 void Fluid::particleBucket() {
-    _rt->selectAttachmentList(0);
+    if (_binning == BIN_RADIX_SORT) {
+        sortedParticleBucket();
+        return;
+    }
+    if (_deterministic) {
+        stableParticleBucket();
+        return;
+    }
+
+    _fbos->bindEmpty(max(_tWidth, _pTexW), max(_tHeight, _pTexH));
     _histoIndex[0]->bindAny();
     _particlePos->bindAny();
     _particleQ->bindAny();
@@ -693,19 +1311,102 @@ void Fluid::particleBucket() {
     _particleBucket->uniformI("ResultP", 0);
     _particleBucket->uniformI("ResultQ", 1);
     _particleBucket->uniformI("Counts", 2);
-    _particleBucket->uniformI("PointInfo", _pTexW, _particleCount);
     _particleBucket->uniformI("Offsets", _histoIndex[0]->boundUnit());
     _particleBucket->uniformI("PPos", _particlePos->boundUnit());
     _particleBucket->uniformI("Q", _particleQ->boundUnit());
+    _particleBucket->uniformI("Affine", _transfer == TRANSFER_APIC);
+    if (_transfer == TRANSFER_APIC)
+        bindParticleGradients(*_particleBucket, true);
+    bindSolid(*_particleBucket);
     glDrawArrays(GL_POINTS, 0, _particleCount);
 
     glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
     swap(_particlePos, _particlePosTmp);
     swap(_particleQ, _particleQTmp);
+    if (_transfer == TRANSFER_APIC)
+        swap(_particleGrad, _particleGradTmp);
+}
+
+/* Same result as particleBucket, but buckets are filled in particle index
+ * order and overfull cells always drop the same particles. ClampCounts
+ * caps buckets at _maxPerCell, so this takes that many point passes plus
+ * one instead of one */
+void Fluid::stableParticleBucket() {
+    _fbos->bindEmpty(max(_tWidth, _pTexW), max(_tHeight, _pTexH));
+    _histoIndex[0]->bindAny();
+    _particlePos->bindAny();
+    _particleQ->bindAny();
+    _particlePosTmp->bindImage(0);
+    _particleQTmp->bindImage(1);
+    _histoCount[0]->bindImage(2);
+    _stableBucket->bind();
+    _stableBucket->uniformI("ResultP", 0);
+    _stableBucket->uniformI("ResultQ", 1);
+    _stableBucket->uniformI("Counts", 2);
+    _stableBucket->uniformI("Placed", 3);
+    _stableBucket->uniformI("Next", 4);
+    _stableBucket->uniformI("Offsets", _histoIndex[0]->boundUnit());
+    _stableBucket->uniformI("PPos", _particlePos->boundUnit());
+    _stableBucket->uniformI("Q", _particleQ->boundUnit());
+    _stableBucket->uniformI("Affine", _transfer == TRANSFER_APIC);
+    if (_transfer == TRANSFER_APIC)
+        bindParticleGradients(*_stableBucket, true);
+    bindSolid(*_stableBucket);
+
+    for (int slot = 0; slot <= _maxPerCell; slot++) {
+        _bucketKeys[1]->clear();
+        _bucketKeys[0]->bindImage(3, true, false);
+        _bucketKeys[1]->bindImage(4);
+        _stableBucket->uniformI("Slot", slot);
+        glDrawArrays(GL_POINTS, 0, _particleCount);
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+        swap(_bucketKeys[0], _bucketKeys[1]);
+    }
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    swap(_particlePos, _particlePosTmp);
+    swap(_particleQ, _particleQTmp);
+    if (_transfer == TRANSFER_APIC)
+        swap(_particleGrad, _particleGradTmp);
+}
+
+/* Fills the buckets straight from the sorted particles in a single pass,
+ * with the same result as stableParticleBucket */
+void Fluid::sortedParticleBucket() {
+    _histoIndex[0]->bindAny();
+    _bucketKeys[0]->bindAny();
+    _bucketKeys[1]->bindAny();
+    _particlePos->bindAny();
+    _particleQ->bindAny();
+    _particlePosTmp->bindImage(0, false);
+    _particleQTmp->bindImage(1, false);
+    _histoCount[0]->bindImage(2);
+    _sortKeys[0]->bindIndexed(2);
+    _sortValues[0]->bindIndexed(3);
+    _sortedBucket->bind();
+    _sortedBucket->uniformI("ResultP", 0);
+    _sortedBucket->uniformI("ResultQ", 1);
+    _sortedBucket->uniformI("Counts", 2);
+    _sortedBucket->uniformI("Starts",  _bucketKeys[0]->boundUnit());
+    _sortedBucket->uniformI("Ends",    _bucketKeys[1]->boundUnit());
+    _sortedBucket->uniformI("Offsets", _histoIndex[0]->boundUnit());
+    _sortedBucket->uniformI("PPos", _particlePos->boundUnit());
+    _sortedBucket->uniformI("Q", _particleQ->boundUnit());
+    _sortedBucket->uniformI("Affine", _transfer == TRANSFER_APIC);
+    if (_transfer == TRANSFER_APIC)
+        bindParticleGradients(*_sortedBucket, true);
+    _sortedBucket->dispatch((_particleCount - 1)/SortBlockSize + 1);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    swap(_particlePos, _particlePosTmp);
+    swap(_particleQ, _particleQTmp);
+    if (_transfer == TRANSFER_APIC)
+        swap(_particleGrad, _particleGradTmp);
 }
 
 void Fluid::particleSpawn() {
-    _rt->selectAttachmentList(0);
+    _fbos->bindEmpty(max(_tWidth, _pTexW), max(_tHeight, _pTexH));
     _histoCount[0]->bindAny();
     _histoIndex[0]->bindAny();
     _particlePos->bindImage(0);
@@ -715,7 +1416,7 @@ void Fluid::particleSpawn() {
     _particleSpawn->uniformI("Offsets", _histoIndex[0]->boundUnit());
     _particleSpawn->uniformI("ResultP", 0);
     _particleSpawn->uniformI("ResultQ", 1);
-    _particleSpawn->uniformI("PointInfo", _pTexW, _particleCount);
+    /* Not tiled: inactive tiles still need their particles topped up */
     shaderQuad(*_particleSpawn, 0, 0, _width - 1, _height - 1);
 
     glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
@@ -726,7 +1427,7 @@ void Fluid::histoPyramid() {
     for (int i = 1; i < _histoLevels; i++) {
         _histoCount[i - 1]->bindAny();
         _histoDownsample->uniformI("Counts", _histoCount[i - 1]->boundUnit());
-        _rt->selectAttachmentList(1, _rt->attachTextureAny(*_histoCount[i]));
+        _fbos->bind(*_histoCount[i]);
         shaderQuad(*_histoDownsample, 0, 0, _histoCount[i]->width(), _histoCount[i]->height());
     }
 
@@ -736,30 +1437,213 @@ void Fluid::histoPyramid() {
         _histoCount[i]->bindAny();
         _histoUpsample->uniformI("Counts", _histoCount[i]->boundUnit());
         _histoUpsample->uniformI("Offsets", _histoIndex[i + 1]->boundUnit());
-        _rt->selectAttachmentList(1, _rt->attachTextureAny(*_histoIndex[i]));
+        _fbos->bind(*_histoIndex[i]);
         shaderQuad(*_histoUpsample, 0, 0, _histoIndex[i]->width(), _histoIndex[i]->height());
     }
 }
 
-void Fluid::clear(Texture &a) {
-    a.bindAny();
-    a.copyPbo(*_blackPbo);
+void Fluid::rasterizeSolid(float x, float y, float w, float h, float radius) {
+    int x0 = max((int)(x/_hX), 0);
+    int y0 = max((int)(y/_hX), 0);
+    int x1 = min((int)ceilf((x + w)/_hX), _width - 1);
+    int y1 = min((int)ceilf((y + h)/_hX), _height - 1);
+
+    if (x1 <= x0 || y1 <= y0)
+        return;
+
+    _fbos->bind(*_solid);
+
+    _obstacle->bind();
+    _obstacle->uniformF("Circle", (x + 0.5f*w)/_hX, (y + 0.5f*h)/_hX, radius/_hX);
+    shaderQuad(*_obstacle, x0, y0, x1 - x0, y1 - y0);
+
+    _solidDirty = true;
+}
+
+void Fluid::updateSolidTiles() {
+    _fbos->bind(*_tileMask);
+    _buildTiles->bind();
+    shaderQuad(*_buildTiles, 0, 0, _tilesX, _tilesY);
+
+    _solidDirty = false;
+}
+
+/* Rebuilds the tile lists from the freshly bucketed particles. With tracking
+ * on, a tile is active if it or one of its neighbours carries particles that
+ * differ from the resting state; the lists and draw counts are produced on
+ * the GPU and consumed through indirect draws, so nothing is read back.
+ * Tiles that went inactive this step are reset to the resting state. */
+void Fluid::updateTiles() {
+    swap(_tileActivity[0], _tileActivity[1]);
+
+    _fbos->bind(*_tileRaw);
+    if (_advection == ADVECT_PARTICLES && _trackTiles) {
+        _particleQ->bindAny();
+        _histoCount[0]->bindAny();
+        _histoIndex[0]->bindAny();
+
+        _markTiles->bind();
+        _markTiles->uniformI("Q", _particleQ->boundUnit());
+        _markTiles->uniformI("Counts",  _histoCount[0]->boundUnit());
+        _markTiles->uniformI("Offsets", _histoIndex[0]->boundUnit());
+        _markTiles->uniformF("Rest", 0.0f, _tAmb, 0.0f, 0.0f);
+        _markTiles->uniformF("Threshold", 1e-3f, 1e-2f, 1e-3f, 1e-3f);
+        shaderQuad(*_markTiles, 0, 0, _tilesX, _tilesY);
+    } else {
+        /* Nothing to track; keep every fluid tile active */
+        _set->bind();
+        _set->uniformF("Value", 1.0f);
+        shaderQuad(*_set, 0, 0, _tilesX, _tilesY);
+    }
+
+    /* Reset the counts in place; the storage was allocated once in the constructor */
+    _tileCommands->bind();
+    _tileCommands->copySubData(emptyTileCommands, 0, sizeof(emptyTileCommands));
+    _tileCommands->unbind();
+
+    _fbos->bindEmpty(max(_tWidth, _pTexW), max(_tHeight, _pTexH));
+    _tileRaw->bindAny();
+    _tileMask->bindAny();
+    _tileActivity[1]->bindAny();
+    for (int i = 0; i < TileListCount; i++)
+        _tileList[i]->bindImage(i, false);
+    _tileActivity[0]->bindImage(TileListCount, false);
+    _tileCounts->bindImage(TileListCount + 1);
+
+    _compactTiles->bind();
+    _compactTiles->uniformI("Raw",      _tileRaw->boundUnit());
+    _compactTiles->uniformI("Fluid",    _tileMask->boundUnit());
+    _compactTiles->uniformI("Previous", _tileActivity[1]->boundUnit());
+    _compactTiles->uniformI("Active",   ActiveTiles);
+    _compactTiles->uniformI("Inactive", InactiveTiles);
+    _compactTiles->uniformI("Retired",  RetiredTiles);
+    _compactTiles->uniformI("Current",  TileListCount);
+    _compactTiles->uniformI("Commands", TileListCount + 1);
+    _compactTiles->uniformI("TileCount", _tilesX, _tilesY);
+    bindSolid(*_compactTiles);
+    glDrawArrays(GL_POINTS, 0, _tilesX*_tilesY);
+
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    Texture *ts[] = {
+        _u, _v, _d, _aDiag, _aPlusX, _aPlusY, _p, _r, _z, _s,
+        _tmp1, _tmp2, _uTmp, _vTmp, _tTmp, _dTmp
+    };
+
+    for (int i = 0; i < 16; i++)
+        fillTiles(*ts[i], 0.0f, RetiredTiles);
+    fillTiles(*_t, _tAmb, RetiredTiles);
+}
+
+void Fluid::addSolidBox(float x, float y, float w, float h) {
+    beginPasses();
+    rasterizeSolid(x, y, w, h, 0.0f);
+    endPasses();
+}
+
+void Fluid::addSolidCircle(float x, float y, float r) {
+    beginPasses();
+    rasterizeSolid(x - r, y - r, 2.0f*r, 2.0f*r, r);
+    endPasses();
+}
+
+void Fluid::clearSolids() {
+    _solid->clear();
+    _solidDirty = true;
+}
+
+void Fluid::setSolvers(CgVariant heat, CgVariant pressure) {
+    _heatSolver     = heat;
+    _pressureSolver = pressure;
+}
+
+/* Pick before the first update; the particles are not resampled from the
+ * grid when switching back to ADVECT_PARTICLES */
+void Fluid::setAdvection(AdvectionScheme scheme) {
+    _advection = scheme;
+
+    /* Only matters where the velocity limits the step more than maxTimestep */
+    _cfl = (scheme == ADVECT_MACCORMACK ? 4.0f : 2.0f);
+}
+
+/* The gradients are allocated when APIC is first selected and zeroed
+ * whenever it is switched on, so the first splat after is plain PIC */
+void Fluid::setTransfer(TransferScheme scheme) {
+    if (scheme == TRANSFER_APIC && _transfer != TRANSFER_APIC) {
+        Texture **ts[] = {&_particleGrad, &_particleGradTmp};
+        for (int i = 0; i < 2; i++) {
+            if (!*ts[i]) {
+                *ts[i] = new Texture(TEXTURE_2D, _pTexW, _pTexH);
+                (*ts[i])->setFormat(TEXEL_FLOAT, 4, 4);
+                (*ts[i])->init();
+            }
+            (*ts[i])->clear();
+        }
+    }
+
+    _transfer   = scheme;
+    _minPerCell = (scheme == TRANSFER_APIC ? 2 : 3);
+    _maxPerCell = (scheme == TRANSFER_APIC ? 4 : 8);
+}
+
+/* The sort buffers are sized for _particleMax and allocated on first use.
+ * Blocks are padded to whole workgroups, and the digit table holds 16
+ * counts per block */
+void Fluid::setBinning(BinningScheme scheme) {
+    if (scheme == BIN_RADIX_SORT && !_sortKeys[0]) {
+        int blocks = (_particleMax - 1)/SortBlockSize + 1;
+
+        for (int i = 0; i < 2; i++) {
+            _sortKeys[i]   = new BufferObject(SHADER_STORAGE_BUFFER, blocks*SortBlockSize*sizeof(uint32_t));
+            _sortValues[i] = new BufferObject(SHADER_STORAGE_BUFFER, blocks*SortBlockSize*sizeof(uint32_t));
+        }
+        _digitCounts = new BufferObject(SHADER_STORAGE_BUFFER, 16*blocks*sizeof(uint32_t));
+        _digitStarts = new BufferObject(SHADER_STORAGE_BUFFER, 16*blocks*sizeof(uint32_t));
+
+        for (int n = 16*blocks; n > 1; ) {
+            n = (n - 1)/SortBlockSize + 1;
+            _scanSums.push_back(new BufferObject(SHADER_STORAGE_BUFFER, n*sizeof(uint32_t)));
+        }
+    }
+
+    _binning = scheme;
+}
+
+void Fluid::setDeterministic(bool deterministic) {
+    _deterministic = deterministic;
+}
+
+/* Tracking confines every grid pass to the active tiles, including the
+ * pressure solve, which then sees the inactive region as p = 0 and does not
+ * match the full-domain solution. Off by default; with it off, every fluid
+ * tile stays active as with grid advection */
+void Fluid::setTileTracking(bool track) {
+    _trackTiles = track;
 }
 
 void Fluid::copy(Texture &dst, Texture &src) {
-    _rt->setReadBuffer(_rt->attachTextureAny(src));
-    dst.bindAny();
-    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, _width - 1, _height - 1);
+    glCopyImageSubData(src.glName(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                       dst.glName(), GL_TEXTURE_2D, 0, 0, 0, 0, _width - 1, _height - 1, 1);
+}
+
+void Fluid::beginPasses() {
+    RenderTarget::pushViewport(0, 0, max(_tWidth, _pTexW), max(_tHeight, _pTexH));
+}
+
+void Fluid::endPasses() {
+    RenderTarget::popViewport();
+    _fbos->unbind();
 }
 
 void Fluid::setup() {
-    _rt->bind();
-    _rt->pushViewport(0, 0, max(_tWidth, _pTexW), max(_tHeight, _pTexH));
+    beginPasses();
 }
 
+/* Ends a frame. Scene edits outside of a frame only use endPasses, so they
+ * do not queue a velocity reduction of their own */
 void Fluid::teardown() {
-    _rt->popViewport();
-    _rt->unbind();
+    queueMaxVelocity();
+    endPasses();
 }
 
 void Fluid::initScene() {
@@ -808,88 +1692,200 @@ void Fluid::initScene() {
     delete[] pData;
     delete[] qData;
 
-    setup();
+    beginPasses();
     particleFromGrid(*_particleQ);
-    teardown();
+    endPasses();
 }
 
-void Fluid::update(float timestep) {
-    particleAdvect(timestep);
+/* Drains the edits queued since the last step. Obstacles are stamped on the
+ * GPU and share a single tile rebuild below; parameter changes reach the
+ * shaders through this step's constants */
+void Fluid::applyEdits() {
+    SceneEdit edit;
+    while (_edits->pop(edit)) {
+        switch (edit.type) {
+        case EDIT_ADD_INFLOW: {
+            Inflow inflow = {edit.x, edit.y, edit.w, edit.h, edit.value, (int)(12500*edit.w*_width/1920)};
+            _inflows.push_back(inflow);
+            break;
+        } case EDIT_MOVE_INFLOW:
+            if (edit.index >= 0 && edit.index < (int)_inflows.size()) {
+                _inflows[edit.index].x = edit.x;
+                _inflows[edit.index].y = edit.y;
+            }
+            break;
+        case EDIT_REMOVE_INFLOW:
+            if (edit.index >= 0 && edit.index < (int)_inflows.size())
+                _inflows.erase(_inflows.begin() + edit.index);
+            break;
+        case EDIT_SOLID_BOX:
+            rasterizeSolid(edit.x, edit.y, edit.w, edit.h, 0.0f);
+            break;
+        case EDIT_SOLID_CIRCLE:
+            rasterizeSolid(edit.x - edit.value, edit.y - edit.value, 2.0f*edit.value, 2.0f*edit.value, edit.value);
+            break;
+        case EDIT_CLEAR_SOLIDS:
+            clearSolids();
+            break;
+        case EDIT_PARAMETER:
+            switch (edit.index) {
+            case PARAM_GRAVITY:             _gravity   = edit.value; break;
+            case PARAM_DIFFUSION:           _diffusion = edit.value; break;
+            case PARAM_DENSITY:             _density   = edit.value; break;
+            case PARAM_AMBIENT_TEMPERATURE: _tAmb      = edit.value; break;
+            case PARAM_VORTICITY:           _vorticity = edit.value; break;
+            default:
+                DBG("Fluid", WARN, "Ignoring unknown parameter %d\n", edit.index);
+            }
+            break;
+        }
+    }
+}
+
+/* Moves the particles and rebuilds the grid fields from them */
+void Fluid::advectParticles() {
+    particleAdvect();
     particleCount();
     histoPyramid();
     particleBucket();
     particleSpawn();
+    updateTiles();
     particleToGrid();
 
     particleExtrapolate(*_d, *_p);
     swap(_d, _p);
+    fillTiles(*_p, _tAmb, InactiveTiles);
     particleExtrapolate(*_t, *_p);
     swap(_t, _p);
-    clear(*_p);
+    _p->clear();
     particleExtrapolate(*_u, *_p);
     swap(_u, _p);
     particleExtrapolate(*_v, *_p);
     swap(_v, _p);
+}
+
+void Fluid::update(float timestep) {
+    applyEdits();
+
+    if (_solidDirty)
+        updateSolidTiles();
+
+    _stepConstants->advance();
+    setStepConstants(timestep);
+
+    if (_advection == ADVECT_PARTICLES)
+        advectParticles();
+    else {
+        updateTiles();
+        advectGrid();
+    }
 
-    clear(*_p);
+    _p->clear();
 
     _set->bind();
     _set->uniformF("Value", 0.0);
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(*_u));
+    _fbos->bind(*_u);
     shaderLoop(*_set, 0, -1, _width, _height + 2);
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(*_v));
+    _fbos->bind(*_v);
     shaderLoop(*_set, -1, 0, _width + 2, _height);
-    _rt->selectAttachmentList(1, _rt->attachTextureAny(*_t));
+    _fbos->bind(*_t);
     _set->uniformF("Value", 0.0);
     shaderLoop(*_set, -1, -1, _width + 1, _height + 1);
 
-    copy(*_uTmp, *_u);
-    copy(*_vTmp, *_v);
+    if (_transfer == TRANSFER_FLIP) {
+        copy(*_uTmp, *_u);
+        copy(*_vTmp, *_v);
+    }
     copy(*_tTmp, *_t);
     copy(*_dTmp, *_d);
 
     buildVorticity(*_p);
-    confineVorticity(1.0, *_p, *_z, *_r);
-    addVorticity(timestep, *_z, *_r, *_s, *_p);
+    confineVorticity(_vorticity, *_p, *_z, *_r);
+    addVorticity(*_z, *_r, *_s, *_p);
     swap(_u, _s);
     swap(_v, _p);
 
-    buildHMat(timestep);
+    buildHMat();
     swap(_t, _r);
-    conjugateGradients(_heatIters);
+    fillTiles(*_r, 0.0f, InactiveTiles);
+    conjugateGradients(_heatIters, _heatSolver, *_heatResidual);
     swap(_t, _p);
-    addBuoyancy(timestep, *_r);
+    fillTiles(*_t, _tAmb, InactiveTiles);
+    addBuoyancy(*_r);
     swap(_v, _r);
 
     buildPRhs(*_r);
-    buildPMat(timestep);
+    buildPMat();
 
-    conjugateGradients(_pressureIters);
+    conjugateGradients(_pressureIters, _pressureSolver, *_pressureResidual);
 
-    applyPressure(*_p, *_z, *_r, timestep);
+    applyPressure(*_p, *_z, *_r);
     swap(_u, _z);
     swap(_v, _r);
 
-    clear(*_z);
-    clear(*_r);
+    _z->clear();
+    _r->clear();
 
     static int t;
-    if (t++) {
-        _histoCount[_histoLevels - 1]->bindAny();
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &_particleCount);
+    if (_advection == ADVECT_PARTICLES && t++) {
+        _histoCount[_histoLevels - 1]->read(&_particleCount);
         printf("# Particles: %d ", _particleCount);
+        uploadStepConstants();
+    }
+
+    int pAdd = 0;
+    for (size_t i = 0; i < _inflows.size(); i++) {
+        const Inflow &in = _inflows[i];
+        int particles = (_advection == ADVECT_PARTICLES ? in.particles : 0);
+        pAdd += addInflow(in.x - 0.5f*in.w, in.y - 0.5f*in.h, in.w, in.h, particles, pAdd,
+                Vec4(0.0, _tAmb, 0.0, 0.0), Vec4(1.0, in.temperature, 0.0, 0.0));
     }
 
-    int pAdd = addInflow(0.68f, 0.05f, 0.4f, 0.01f, 5000*_width/1920, Vec4(0.0, _tAmb, 0.0, 0.0), Vec4(1.0, 200.0, 0.0, 0.0));
+    if (_advection != ADVECT_PARTICLES)
+        return;
 
     particleFromGrid(*_particleQ);
 
     _particleCount += pAdd;
+    uploadStepConstants();
 }
 
 float Fluid::recommendedTimestep() {
     calcVelocity(*_uTmp);
     float maxU = maxReduce(*_uTmp, *_dotPTransfer[0]);
 
-    return 2.0f/maxU;
+    return _cfl/maxU;
+}
+
+/* Reduces the velocity at the end of a frame and starts copying the result
+ * back, for estimatedTimestep to pick up once the GPU gets there */
+void Fluid::queueMaxVelocity() {
+    calcVelocity(*_uTmp);
+    parallelReduce(*_maxReduce, *_uTmp, *_dotPTransfer[0], 2);
+    _maxVelocity->readTexture(*_dotPTransfer[0], GL_RED, GL_FLOAT);
+}
+
+/* Like recommendedTimestep, but from the newest velocity reduction that has
+ * already completed, so the frame's substeps can be picked without draining
+ * the GPU first. There is nothing to go on until the first queued reduction
+ * completes: the first frame reduces synchronously, and the next one waits in
+ * finish() for the reduction queued by the first. Later frames never block
+ * here, although update() itself still reads back the particle count */
+float Fluid::estimatedTimestep() {
+    if (!_maxVelocity->poll()) {
+        if (!_maxVelocity->pending())
+            return recommendedTimestep();
+        _maxVelocity->finish();
+    }
+
+    const float *lastStep = (const float *)_maxVelocity->latest();
+    float maxU = max(lastStep[0], max(lastStep[1], max(lastStep[2], lastStep[3])));
+
+    return TimestepSafety*_cfl/maxU;
+}
+
+/* Upper bound on a substep regardless of the flow speed, for the explicit
+ * buoyancy and vorticity forces */
+float Fluid::maxTimestep() {
+    return _maxTimestep;
 }
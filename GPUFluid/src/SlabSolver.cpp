@@ -0,0 +1,423 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+
+#include <algorithm>
+#include <GL/glew.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "SlabSolver.hpp"
+#include "Fluid3D.hpp"
+#include "render/BufferObject.hpp"
+#include "render/Context.hpp"
+#include "render/Shader.hpp"
+#include "render/Texture.hpp"
+#include "Debug.hpp"
+
+using namespace std;
+
+static GLuint createField(int width, int height, int depth, const float *zeros) {
+    GLuint name;
+    glGenTextures(1, &name);
+    glBindTexture(GL_TEXTURE_3D, name);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, width, height, depth, 0, GL_RED, GL_FLOAT, zeros);
+
+    return name;
+}
+
+static float *mapStorage(BufferObject &buffer, GLsizei size) {
+    int flags = MAP_READ | MAP_WRITE | MAP_PERSISTENT | MAP_COHERENT;
+
+    buffer.initStorage(size, flags);
+    buffer.bind();
+    buffer.mapRange(0, size, flags);
+    buffer.unbind();
+    memset(buffer.data(), 0, size);
+
+    return (float *)buffer.data();
+}
+
+SlabSolver::SlabSolver(int width, int height, int depth, int slabs) :
+    _slabCount(slabs), _width(width), _height(height), _depth(depth) {
+    ASSERT(slabs > 0 && slabs <= height, "Invalid slab count %d\n", slabs);
+
+    _groupsX = (_width - 1)/8 + 1;
+    _groupsZ = (_depth - 1)/4 + 1;
+
+    _job = _finished = 0;
+    _arrived = _generation = 0;
+    _quit = false;
+
+    _reduction[0] = new float[_slabCount];
+    _reduction[1] = new float[_slabCount];
+
+    _slabs = new Slab[_slabCount];
+    for (int i = 0, y = 0; i < _slabCount; i++) {
+        Slab &s = _slabs[i];
+        s.rowBegin = y;
+        s.rows     = _height/_slabCount + (i < _height % _slabCount ? 1 : 0);
+        s.groupsY  = (s.rows - 1)/8 + 1;
+        s.context  = new Context(true);
+        y += s.rows;
+    }
+
+    _threads = new thread[_slabCount];
+    for (int i = 0; i < _slabCount; i++)
+        _threads[i] = thread(&SlabSolver::run, this, i);
+}
+
+SlabSolver::~SlabSolver() {
+    {
+        unique_lock<mutex> lock(_mutex);
+        _quit = true;
+    }
+    _jobStarted.notify_all();
+
+    for (int i = 0; i < _slabCount; i++) {
+        _threads[i].join();
+        delete _slabs[i].context;
+    }
+
+    delete[] _threads;
+    delete[] _slabs;
+    delete[] _reduction[0];
+    delete[] _reduction[1];
+}
+
+void SlabSolver::setup(Slab &s) {
+    s.cgInit      = new Shader("../src/shaders/Fluid3D/", "Preamble.txt", "CgInit.comp");
+    s.matVec      = new Shader("../src/shaders/Fluid3D/", "Preamble.txt", "MatVecProduct.comp");
+    s.cgUpdate    = new Shader("../src/shaders/Fluid3D/", "Preamble.txt", "CgUpdate.comp");
+    s.cgDirection = new Shader("../src/shaders/Fluid3D/", "Preamble.txt", "CgDirection.comp");
+    s.reduce      = new Shader("../src/shaders/Fluid3D/", "Preamble.txt", "Reduce.comp");
+    s.maxReduce   = new Shader("../src/shaders/Fluid3D/", "Preamble.txt", "MaxReduce.comp");
+    s.packHalo    = new Shader("../src/shaders/Fluid3D/", "Preamble.txt", "PackHalo.comp");
+    s.unpackHalo  = new Shader("../src/shaders/Fluid3D/", "Preamble.txt", "UnpackHalo.comp");
+
+    int cells = _width*(s.rows + 2)*_depth;
+    int plane = _width*_depth;
+
+    float *zeros = new float[cells];
+    memset(zeros, 0, cells*sizeof(float));
+
+    s.p = createField(_width, s.rows + 2, _depth, zeros);
+    s.r = createField(_width, s.rows + 2, _depth, zeros);
+    s.z = createField(_width, s.rows + 2, _depth, zeros);
+    s.s = createField(_width, s.rows + 2, _depth, zeros);
+    s.q = createField(_width, s.rows + 2, _depth, zeros);
+
+    delete[] zeros;
+
+    int groups = _groupsX*((s.rows + 1)/8 + 1)*_groupsZ;
+    s.partials = new BufferObject(SHADER_STORAGE_BUFFER, groups*sizeof(float));
+    s.scalars  = new BufferObject(SHADER_STORAGE_BUFFER);
+    s.haloOut  = new BufferObject(SHADER_STORAGE_BUFFER);
+    s.haloIn   = new BufferObject(SHADER_STORAGE_BUFFER);
+
+    s.scalarData  = mapStorage(*s.scalars, ScalarCount*sizeof(float));
+    s.haloOutData = mapStorage(*s.haloOut, 2*plane*sizeof(float));
+    s.haloInData  = mapStorage(*s.haloIn,  2*plane*sizeof(float));
+
+    s.partials->bindIndexed(4);
+    s.scalars ->bindIndexed(5);
+
+    glBindImageTexture(0, s.p, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+    glBindImageTexture(1, s.r, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+    glBindImageTexture(2, s.z, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+    glBindImageTexture(3, s.s, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+    glBindImageTexture(4, s.q, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, s.r);
+
+    Shader *images[] = {s.cgInit, s.matVec, s.cgUpdate, s.cgDirection, s.packHalo, s.unpackHalo};
+    for (int i = 0; i < 6; i++) {
+        images[i]->bind();
+        images[i]->uniformI("Slab", 1, s.rows + 1, s.rowBegin - 1);
+    }
+
+    s.cgInit->bind();
+    s.cgInit->uniformI("P", 0);
+    s.cgInit->uniformI("R", 1);
+    s.cgInit->uniformI("Z", 2);
+    s.cgInit->uniformI("S", 3);
+
+    s.matVec->bind();
+    s.matVec->uniformI("S", 3);
+    s.matVec->uniformI("Q", 4);
+
+    s.cgUpdate->bind();
+    s.cgUpdate->uniformI("P", 0);
+    s.cgUpdate->uniformI("R", 1);
+    s.cgUpdate->uniformI("Z", 2);
+    s.cgUpdate->uniformI("S", 3);
+    s.cgUpdate->uniformI("Q", 4);
+
+    s.cgDirection->bind();
+    s.cgDirection->uniformI("Z", 2);
+    s.cgDirection->uniformI("S", 3);
+
+    s.packHalo->bind();
+    s.packHalo->uniformI("S", 3);
+    s.unpackHalo->bind();
+    s.unpackHalo->uniformI("S", 3);
+
+    s.maxReduce->bind();
+    s.maxReduce->uniformI("Src", 0);
+}
+
+void SlabSolver::teardown(Slab &s) {
+    Shader *shaders[] = {s.cgInit, s.matVec, s.cgUpdate, s.cgDirection,
+        s.reduce, s.maxReduce, s.packHalo, s.unpackHalo};
+    for (int i = 0; i < 8; i++)
+        delete shaders[i];
+
+    GLuint fields[] = {s.p, s.r, s.z, s.s, s.q};
+    glDeleteTextures(5, fields);
+
+    delete s.partials;
+    delete s.scalars;
+    delete s.haloOut;
+    delete s.haloIn;
+}
+
+void SlabSolver::run(int index) {
+    Slab &s = _slabs[index];
+
+    s.context->makeCurrent();
+    setup(s);
+
+    int job = 0;
+    for (;;) {
+        {
+            unique_lock<mutex> lock(_mutex);
+            while (!_quit && _job == job)
+                _jobStarted.wait(lock);
+            if (_quit)
+                break;
+            job = _job;
+        }
+
+        solveSlab(index);
+
+        {
+            unique_lock<mutex> lock(_mutex);
+            if (++_finished == _slabCount)
+                _jobFinished.notify_one();
+        }
+    }
+
+    teardown(s);
+    s.context->release();
+}
+
+void SlabSolver::barrier() {
+    unique_lock<mutex> lock(_mutex);
+
+    int generation = _generation;
+    if (++_arrived == _slabCount) {
+        _arrived = 0;
+        _generation++;
+        _barrierReached.notify_all();
+    } else {
+        while (generation == _generation)
+            _barrierReached.wait(lock);
+    }
+}
+
+/* Waits for the slab's queued work, after which the mapped buffers hold what
+ * the shaders wrote and the GPU no longer reads them */
+void SlabSolver::finish(Slab &s) {
+    glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fence);
+}
+
+/* Partial results are combined in slab order, so every slab sees the same
+ * value regardless of which thread finished first */
+float SlabSolver::combine(int index, int &phase, float value, int mode) {
+    float *slots = _reduction[phase];
+    slots[index] = value;
+    barrier();
+
+    float result = slots[0];
+    for (int i = 1; i < _slabCount; i++)
+        result = (mode == ReduceSum ? result + slots[i] : max(result, slots[i]));
+
+    phase ^= 1;
+    return result;
+}
+
+float SlabSolver::reduceSlab(Slab &s, int groups, int mode) {
+    s.reduce->bind();
+    s.reduce->uniformI("Count", groups);
+    s.reduce->uniformI("Dst", MaxSlot);
+    s.reduce->uniformI("Mode", mode);
+    s.reduce->dispatch(1);
+
+    finish(s);
+
+    return s.scalarData[MaxSlot];
+}
+
+/* Only called right after reduceSlab, while the GPU is idle */
+void SlabSolver::setScalar(Slab &s, int slot, float value) {
+    s.scalarData[slot] = value;
+}
+
+void SlabSolver::exchangeHalo(int index) {
+    Slab &s = _slabs[index];
+    int plane = _width*_depth;
+    int groupsX = (_width - 1)/8 + 1, groupsZ = (_depth - 1)/8 + 1;
+
+    s.haloOut->bindIndexed(6);
+    s.packHalo->bind();
+    s.packHalo->dispatch(groupsX, groupsZ);
+    finish(s);
+
+    /* A slab packs again only after the next combine, which every neighbour
+     * reaches after copying, so the mapped rows are not overwritten early */
+    barrier();
+
+    if (index > 0)
+        memcpy(s.haloInData, _slabs[index - 1].haloOutData + plane, plane*sizeof(float));
+    if (index < _slabCount - 1)
+        memcpy(s.haloInData + plane, _slabs[index + 1].haloOutData, plane*sizeof(float));
+
+    s.haloIn->bindIndexed(6);
+    s.unpackHalo->bind();
+    s.unpackHalo->dispatch(groupsX, groupsZ);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void SlabSolver::dispatch(Slab &s, Shader &shader) {
+    shader.dispatch(_groupsX, s.groupsY, _groupsZ);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void SlabSolver::solveSlab(int index) {
+    Slab &s = _slabs[index];
+    int groups = _groupsX*s.groupsY*_groupsZ;
+    int sigma = SigmaSlot0, sigmaN = SigmaSlot1;
+    int phase = 0;
+
+    glWaitSync(_ready, 0, GL_TIMEOUT_IGNORED);
+    glCopyImageSubData(_b, GL_TEXTURE_3D, 0, 0, s.rowBegin, 0,
+                       s.r, GL_TEXTURE_3D, 0, 0, 1, 0, _width, s.rows, _depth);
+
+    s.cgInit->bind();
+    s.cgInit->uniformF("Base", _base);
+    s.cgInit->uniformF("Scale", _scale);
+    dispatch(s, *s.cgInit);
+    setScalar(s, sigma, combine(index, phase, reduceSlab(s, groups, ReduceSum), ReduceSum));
+
+    exchangeHalo(index);
+
+    s.matVec->bind();
+    s.matVec->uniformF("Base", _base);
+    s.matVec->uniformF("Scale", _scale);
+
+    s.cgUpdate->bind();
+    s.cgUpdate->uniformF("Base", _base);
+    s.cgUpdate->uniformF("Scale", _scale);
+
+    for (int i = 0; i < _iters; i++) {
+        s.matVec->bind();
+        dispatch(s, *s.matVec);
+        setScalar(s, DotSlot, combine(index, phase, reduceSlab(s, groups, ReduceSum), ReduceSum));
+
+        s.cgUpdate->bind();
+        s.cgUpdate->uniformI("Sigma", sigma);
+        dispatch(s, *s.cgUpdate);
+        setScalar(s, sigmaN, combine(index, phase, reduceSlab(s, groups, ReduceSum), ReduceSum));
+
+        s.cgDirection->bind();
+        s.cgDirection->uniformI("Sigma", sigma);
+        s.cgDirection->uniformI("SigmaN", sigmaN);
+        dispatch(s, *s.cgDirection);
+
+        exchangeHalo(index);
+
+        swap(sigma, sigmaN);
+    }
+
+    int rowGroups = (s.rows + 1)/8 + 1;
+    s.maxReduce->bind();
+    s.maxReduce->dispatch(_groupsX, rowGroups, _groupsZ);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    float residual = combine(index, phase, reduceSlab(s, _groupsX*rowGroups*_groupsZ, ReduceMax), ReduceMax);
+    if (index == 0)
+        _residual = residual;
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glCopyImageSubData(s.p, GL_TEXTURE_3D, 0, 0, 1, 0,
+                       _x, GL_TEXTURE_3D, 0, 0, s.rowBegin, 0, _width, s.rows, _depth);
+
+    s.done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+void SlabSolver::solve(Texture &b, Texture &x, float base, float scale, int &iters) {
+    /* b was written by shaders; the slabs copy it once the fence signals */
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    GLsync ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    {
+        unique_lock<mutex> lock(_mutex);
+        _b = b.glName();
+        _x = x.glName();
+        _ready = ready;
+        _base = base;
+        _scale = scale;
+        _iters = iters;
+        _finished = 0;
+        _job++;
+    }
+    _jobStarted.notify_all();
+
+    {
+        unique_lock<mutex> lock(_mutex);
+        while (_finished < _slabCount)
+            _jobFinished.wait(lock);
+    }
+
+    glDeleteSync(ready);
+    for (int i = 0; i < _slabCount; i++) {
+        glWaitSync(_slabs[i].done, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(_slabs[i].done);
+    }
+
+    if (_residual > 1e-2)
+        iters = min(iters + 10, 4000);
+    else {
+        iters = max(iters - 1, 10);
+        printf("Residual error: %f, iters %d\n", _residual, iters);
+    }
+}
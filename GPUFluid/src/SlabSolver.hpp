@@ -0,0 +1,102 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#ifndef SLABSOLVER_HPP_
+#define SLABSOLVER_HPP_
+
+#include <condition_variable>
+#include <thread>
+#include <mutex>
+#include <GL/gl.h>
+
+class BufferObject;
+class Context;
+class Shader;
+class Texture;
+
+/* Runs the Fluid3D CG solves split into horizontal slabs, each owned by its
+ * own thread and GL context. Every slab stores one ghost row above and below
+ * its owned rows, which is refreshed from the neighbouring slabs after each
+ * search direction update. Ghost rows and reduction results travel through
+ * persistently mapped buffers. The slab contexts share objects with the
+ * context that creates the solver, so the right-hand side and the solution
+ * are copied between textures without leaving the GPU. */
+class SlabSolver {
+    struct Slab {
+        Context *context;
+
+        Shader *cgInit, *matVec, *cgUpdate, *cgDirection;
+        Shader *reduce, *maxReduce, *packHalo, *unpackHalo;
+
+        GLuint p, r, z, s, q;
+        BufferObject *partials, *scalars, *haloOut, *haloIn;
+        float *scalarData, *haloOutData, *haloInData;
+        GLsync done;
+
+        int rowBegin, rows;
+        int groupsY;
+    };
+
+    Slab *_slabs;
+    std::thread *_threads;
+    int _slabCount;
+
+    int _width, _height, _depth;
+    int _groupsX, _groupsZ;
+
+    std::mutex _mutex;
+    std::condition_variable _jobStarted, _jobFinished, _barrierReached;
+    int _job, _finished;
+    int _arrived, _generation;
+    bool _quit;
+
+    GLuint _b, _x;
+    GLsync _ready;
+    float _base, _scale;
+    int _iters;
+    float _residual;
+
+    float *_reduction[2];
+
+    void run(int index);
+    void setup(Slab &s);
+    void teardown(Slab &s);
+    void solveSlab(int index);
+
+    void barrier();
+    void finish(Slab &s);
+    float combine(int index, int &phase, float value, int mode);
+    float reduceSlab(Slab &s, int groups, int mode);
+    void setScalar(Slab &s, int slot, float value);
+    void exchangeHalo(int index);
+    void dispatch(Slab &s, Shader &shader);
+
+public:
+    SlabSolver(int width, int height, int depth, int slabs);
+    ~SlabSolver();
+
+    void solve(Texture &b, Texture &x, float base, float scale, int &iters);
+};
+
+#endif /* SLABSOLVER_HPP_ */
@@ -37,6 +37,21 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <fstream>
 #endif /*LODEPNG_COMPILE_CPP*/
 
+#ifdef LODEPNG_COMPILE_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+#if defined(LODEPNG_COMPILE_DISK) && defined(LODEPNG_COMPILE_ENCODER)
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#endif
+
 #define VERSION_STRING "20121216"
 
 /*
@@ -220,7 +235,7 @@ static unsigned ucvector_resize(ucvector* p, size_t size)
   return 1;
 }
 
-#ifdef LODEPNG_COMPILE_PNG
+#if defined(LODEPNG_COMPILE_PNG) || defined(LODEPNG_COMPILE_ENCODER)
 
 static void ucvector_cleanup(void* p)
 {
@@ -245,7 +260,7 @@ static unsigned ucvector_resizev(ucvector* p, size_t size, unsigned char value)
   return 1;
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
-#endif /*LODEPNG_COMPILE_PNG*/
+#endif /*defined(LODEPNG_COMPILE_PNG) || defined(LODEPNG_COMPILE_ENCODER)*/
 
 #ifdef LODEPNG_COMPILE_ZLIB
 /*you can both convert from vector to buffer&size and vica versa. If you use
@@ -338,6 +353,107 @@ static void lodepng_add32bitInt(ucvector* buffer, unsigned value)
 }
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
+/* ////////////////////////////////////////////////////////////////////////// */
+/* / Worker Threads                                                         / */
+/* ////////////////////////////////////////////////////////////////////////// */
+
+typedef struct WorkerPool WorkerPool; /*only defined with LODEPNG_COMPILE_THREADS*/
+
+#ifdef LODEPNG_COMPILE_THREADS
+typedef void (*WorkerJob)(void* arg, unsigned index);
+
+/*
+Helper threads that wait between runs instead of being started and joined for every image.
+A run hands job index i to helper i, and index 0 to the calling thread.
+*/
+struct WorkerPool
+{
+  std::vector<std::thread> helpers;
+  std::mutex mutex;
+  std::condition_variable start, done;
+  WorkerJob job;
+  void* arg;
+  unsigned count; /*number of jobs in the current run*/
+  unsigned remaining; /*jobs of the current run that helpers have not finished yet*/
+  unsigned generation; /*counts the runs, so that a helper takes part in each run once*/
+  bool quit;
+};
+
+static void workerLoop(WorkerPool* pool, unsigned index)
+{
+  unsigned seen = 0;
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  for(;;)
+  {
+    while(!pool->quit && pool->generation == seen) pool->start.wait(lock);
+    if(pool->quit) return;
+    seen = pool->generation;
+    if(index >= pool->count) continue;
+
+    lock.unlock();
+    pool->job(pool->arg, index);
+    lock.lock();
+    if(--pool->remaining == 0) pool->done.notify_one();
+  }
+}
+
+static WorkerPool* workerPoolNew(unsigned numhelpers)
+{
+  unsigned i;
+  WorkerPool* pool = new WorkerPool;
+  pool->job = 0;
+  pool->arg = 0;
+  pool->count = pool->remaining = pool->generation = 0;
+  pool->quit = false;
+  for(i = 1; i <= numhelpers; i++) pool->helpers.push_back(std::thread(workerLoop, pool, i));
+  return pool;
+}
+
+static void workerPoolDelete(WorkerPool* pool)
+{
+  size_t i;
+  if(!pool) return;
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->quit = true;
+  }
+  pool->start.notify_all();
+  for(i = 0; i < pool->helpers.size(); i++) pool->helpers[i].join();
+  delete pool;
+}
+
+/*runs job(arg, i) for i from 0 to count - 1 and returns when all are done. count - 1 must not exceed the helpers*/
+static void workerPoolRun(WorkerPool* pool, unsigned count, WorkerJob job, void* arg)
+{
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->job = job;
+    pool->arg = arg;
+    pool->count = count;
+    pool->remaining = count - 1;
+    pool->generation++;
+  }
+  pool->start.notify_all();
+
+  job(arg, 0);
+
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  while(pool->remaining) pool->done.wait(lock);
+}
+
+/*like workerPoolRun, with helpers that only live for this run if no pool is given*/
+static void workerPoolRunTemporary(WorkerPool* pool, unsigned count, WorkerJob job, void* arg)
+{
+  if(pool) workerPoolRun(pool, count, job, arg);
+  else
+  {
+    pool = workerPoolNew(count - 1);
+    workerPoolRun(pool, count, job, arg);
+    workerPoolDelete(pool);
+  }
+}
+#endif /*LODEPNG_COMPILE_THREADS*/
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / File IO                                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -1371,9 +1487,16 @@ typedef struct Hash
   unsigned short* zeros;
 } Hash;
 
-static unsigned hash_init(Hash* hash, unsigned windowsize)
+static void hash_reset(Hash* hash, unsigned windowsize)
 {
   unsigned i;
+  for(i = 0; i < HASH_NUM_VALUES; i++) hash->head[i] = -1;
+  for(i = 0; i < windowsize; i++) hash->val[i] = -1;
+  for(i = 0; i < windowsize; i++) hash->chain[i] = i; /*same value as index indicates uninitialized*/
+}
+
+static unsigned hash_init(Hash* hash, unsigned windowsize)
+{
   hash->head = (int*)mymalloc(sizeof(int) * HASH_NUM_VALUES);
   hash->val = (int*)mymalloc(sizeof(int) * windowsize);
   hash->chain = (unsigned short*)mymalloc(sizeof(unsigned short) * windowsize);
@@ -1382,9 +1505,7 @@ static unsigned hash_init(Hash* hash, unsigned windowsize)
   if(!hash->head || !hash->val || !hash->chain || !hash->zeros) return 83; /*alloc fail*/
 
   /*initialize hash table*/
-  for(i = 0; i < HASH_NUM_VALUES; i++) hash->head[i] = -1;
-  for(i = 0; i < windowsize; i++) hash->val[i] = -1;
-  for(i = 0; i < windowsize; i++) hash->chain[i] = i; /*same value as index indicates uninitialized*/
+  hash_reset(hash, windowsize);
 
   return 0;
 }
@@ -1397,6 +1518,53 @@ static void hash_cleanup(Hash* hash)
   myfree(hash->zeros);
 }
 
+/*
+The buffers deflating one range of the input works in. A one-off encode sets them up for the
+call only; a LodePNGEncoderContext keeps them, with their capacity, from one image to the next.
+*/
+typedef struct DeflateScratch
+{
+  Hash hash;
+  unsigned hashsize; /*window size the hash tables are allocated for, 0 if not allocated*/
+  uivector lz77_encoded;
+  ucvector out; /*deflated data of a range that is not written to the output directly*/
+  unsigned error; /*result of the range last deflated in this scratch*/
+} DeflateScratch;
+
+static void deflate_scratch_init(DeflateScratch* scratch)
+{
+  scratch->hashsize = 0;
+  uivector_init(&scratch->lz77_encoded);
+  ucvector_init(&scratch->out);
+}
+
+static void deflate_scratch_cleanup(DeflateScratch* scratch)
+{
+  if(scratch->hashsize) hash_cleanup(&scratch->hash);
+  uivector_cleanup(&scratch->lz77_encoded);
+  ucvector_cleanup(&scratch->out);
+}
+
+/*readies the hash for a new range, only allocating when the window size changed*/
+static unsigned deflate_scratch_hash(DeflateScratch* scratch, unsigned windowsize)
+{
+  if(scratch->hashsize == windowsize)
+  {
+    hash_reset(&scratch->hash, windowsize);
+    return 0;
+  }
+
+  if(scratch->hashsize) hash_cleanup(&scratch->hash);
+  scratch->hashsize = 0;
+  if(hash_init(&scratch->hash, windowsize))
+  {
+    hash_cleanup(&scratch->hash);
+    return 83; /*alloc fail*/
+  }
+  scratch->hashsize = windowsize;
+  return 0;
+}
+
 static unsigned getHash(const unsigned char* data, size_t size, size_t pos)
 {
   unsigned result = 0;
@@ -1665,7 +1833,7 @@ static void writeLZ77data(size_t* bp, ucvector* out, const uivector* lz77_encode
 }
 
 /*Deflate for a block of type "dynamic", that is, with freely, optimally, created huffman trees*/
-static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
+static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash, uivector* lz77_encoded,
                                const unsigned char* data, size_t datapos, size_t dataend,
                                const LodePNGCompressSettings* settings, int final)
 {
@@ -1682,8 +1850,6 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   the code length code lengths ("clcl").
   */
 
-  /*The lz77 encoded data, represented with integers since there will also be length and distance codes in it*/
-  uivector lz77_encoded;
   HuffmanTree tree_ll; /*tree for lit,len values*/
   HuffmanTree tree_d; /*tree for distance codes*/
   HuffmanTree tree_cl; /*tree for encoding the code lengths representing tree_ll and tree_d*/
@@ -1709,7 +1875,9 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   size_t numcodes_ll, numcodes_d, i;
   unsigned HLIT, HDIST, HCLEN;
 
-  uivector_init(&lz77_encoded);
+  /*lz77_encoded is the lz77 encoded data, represented with integers since there will also be length
+  and distance codes in it. Its memory is owned by the caller*/
+  lz77_encoded->size = 0;
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
   HuffmanTree_init(&tree_cl);
@@ -1726,27 +1894,27 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   {
     if(settings->use_lz77)
     {
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
+      error = encodeLZ77(lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
                          settings->minmatch, settings->nicematch, settings->lazymatching);
       if(error) break;
     }
     else
     {
-      if(!uivector_resize(&lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
-      for(i = datapos; i < dataend; i++) lz77_encoded.data[i] = data[i]; /*no LZ77, but still will be Huffman compressed*/
+      if(!uivector_resize(lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
+      for(i = datapos; i < dataend; i++) lz77_encoded->data[i] = data[i]; /*no LZ77, but still will be Huffman compressed*/
     }
 
     if(!uivector_resizev(&frequencies_ll, 286, 0)) ERROR_BREAK(83 /*alloc fail*/);
     if(!uivector_resizev(&frequencies_d, 30, 0)) ERROR_BREAK(83 /*alloc fail*/);
 
     /*Count the frequencies of lit, len and dist codes*/
-    for(i = 0; i < lz77_encoded.size; i++)
+    for(i = 0; i < lz77_encoded->size; i++)
     {
-      unsigned symbol = lz77_encoded.data[i];
+      unsigned symbol = lz77_encoded->data[i];
       frequencies_ll.data[symbol]++;
       if(symbol > 256)
       {
-        unsigned dist = lz77_encoded.data[i + 2];
+        unsigned dist = lz77_encoded->data[i + 2];
         frequencies_d.data[dist]++;
         i += 3;
       }
@@ -1885,7 +2053,7 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
     }
 
     /*write the compressed data symbols*/
-    writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
+    writeLZ77data(bp, out, lz77_encoded, &tree_ll, &tree_d);
     /*error: the length of the end code 256 must be larger than 0*/
     if(HuffmanTree_getLength(&tree_ll, 256) == 0) ERROR_BREAK(64);
 
@@ -1896,7 +2064,6 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   }
 
   /*cleanup*/
-  uivector_cleanup(&lz77_encoded);
   HuffmanTree_cleanup(&tree_ll);
   HuffmanTree_cleanup(&tree_d);
   HuffmanTree_cleanup(&tree_cl);
@@ -1910,7 +2077,7 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   return error;
 }
 
-static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
+static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash, uivector* lz77_encoded,
                              const unsigned char* data,
                              size_t datapos, size_t dataend,
                              const LodePNGCompressSettings* settings, int final)
@@ -1934,12 +2101,10 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
 
   if(settings->use_lz77) /*LZ77 encoded*/
   {
-    uivector lz77_encoded;
-    uivector_init(&lz77_encoded);
-    error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
+    lz77_encoded->size = 0;
+    error = encodeLZ77(lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
                        settings->minmatch, settings->nicematch, settings->lazymatching);
-    if(!error) writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
-    uivector_cleanup(&lz77_encoded);
+    if(!error) writeLZ77data(bp, out, lz77_encoded, &tree_ll, &tree_d);
   }
   else /*no LZ77, but still will be Huffman compressed*/
   {
@@ -1958,17 +2123,22 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings)
+/*
+Deflates in[start..end) as a series of blocks. The hash is first filled with up to one window of
+the bytes before start, so matches can still reach back across start. If final is not set, the
+last block is followed by an empty stored block ("sync flush") so the output ends on a byte
+boundary and ranges deflated separately can be concatenated into one stream.
+*/
+static unsigned deflateRange(ucvector* out, const unsigned char* in, size_t start, size_t end,
+                             const LodePNGCompressSettings* settings, int final, DeflateScratch* scratch)
 {
   unsigned error = 0;
-  size_t i, blocksize, numdeflateblocks;
+  size_t i, pos, blocksize, numdeflateblocks;
+  size_t insize = end - start;
   size_t bp = 0; /*the bit pointer*/
-  Hash hash;
+  Hash* hash = &scratch->hash;
 
-  if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
-  else if(settings->btype == 1) blocksize = insize;
+  if(settings->btype == 1) blocksize = insize;
   else /*if(settings->btype == 2)*/
   {
     blocksize = insize / 8 + 8;
@@ -1978,21 +2148,136 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   numdeflateblocks = (insize + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
-  error = hash_init(&hash, settings->windowsize);
+  error = deflate_scratch_hash(scratch, settings->windowsize);
   if(error) return error;
 
+  for(pos = start > settings->windowsize ? start - settings->windowsize : 0; pos < start; pos++)
+  {
+    unsigned hashval = getHash(in, start, pos);
+    updateHashChain(hash, pos, hashval, settings->windowsize);
+    if(hashval == 0) hash->zeros[pos % settings->windowsize] = countZeros(in, start, pos);
+  }
+
   for(i = 0; i < numdeflateblocks && !error; i++)
   {
-    int final = i == numdeflateblocks - 1;
-    size_t start = i * blocksize;
-    size_t end = start + blocksize;
-    if(end > insize) end = insize;
+    int blockfinal = final && i == numdeflateblocks - 1;
+    size_t blockstart = start + i * blocksize;
+    size_t blockend = blockstart + blocksize;
+    if(blockend > end) blockend = end;
+
+    if(settings->btype == 1)
+      error = deflateFixed(out, &bp, hash, &scratch->lz77_encoded, in, blockstart, blockend, settings, blockfinal);
+    else
+      error = deflateDynamic(out, &bp, hash, &scratch->lz77_encoded, in, blockstart, blockend, settings, blockfinal);
+  }
+
+  if(!error && !final)
+  {
+    /*BFINAL 0 and BTYPE 00, then LEN 0 and NLEN 0xffff from the next byte boundary*/
+    addBitsToStream(&bp, out, 0, 3);
+    if(!ucvector_push_back(out, 0) || !ucvector_push_back(out, 0) ||
+       !ucvector_push_back(out, 255) || !ucvector_push_back(out, 255)) error = 83; /*alloc fail*/
+  }
+
+  return error;
+}
+
+#ifdef LODEPNG_COMPILE_THREADS
+
+/*below this many bytes per thread, starting threads costs more than it saves*/
+static const size_t MIN_PARALLEL_DEFLATE_SIZE = 65536;
+
+/*one deflateParallel call, shared by the jobs of its ranges*/
+typedef struct DeflateJobs
+{
+  ucvector* out;
+  const unsigned char* in;
+  size_t insize;
+  size_t rangesize;
+  unsigned numranges;
+  const LodePNGCompressSettings* settings;
+  DeflateScratch* scratch;
+} DeflateJobs;
+
+/*the first range is deflated into the output directly, the others into their scratch output*/
+static void deflateRangeJob(void* arg, unsigned index)
+{
+  DeflateJobs* jobs = (DeflateJobs*)arg;
+  DeflateScratch* scratch = &jobs->scratch[index];
+  size_t start = index * jobs->rangesize;
+  size_t end = start + jobs->rangesize < jobs->insize ? start + jobs->rangesize : jobs->insize;
+
+  if(index) scratch->out.size = 0;
+  scratch->error = deflateRange(index ? &scratch->out : jobs->out, jobs->in, start, end, jobs->settings,
+                                index == jobs->numranges - 1, scratch);
+}
 
-    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+/*
+Deflates equal ranges of the input on up to numscratch threads and appends them to out. The
+helper threads come from workers, or only live for this call if it is NULL.
+*/
+static unsigned deflateParallel(ucvector* out, const unsigned char* in, size_t insize,
+                                const LodePNGCompressSettings* settings,
+                                DeflateScratch* scratch, unsigned numscratch, WorkerPool* workers)
+{
+  unsigned error = 0;
+  size_t i, numranges = insize / MIN_PARALLEL_DEFLATE_SIZE;
+  DeflateJobs jobs;
+  if(numranges > numscratch) numranges = numscratch;
+  if(numranges <= 1) return deflateRange(out, in, 0, insize, settings, 1, &scratch[0]);
+
+  jobs.out = out;
+  jobs.in = in;
+  jobs.insize = insize;
+  jobs.rangesize = (insize + numranges - 1) / numranges;
+  jobs.numranges = (unsigned)numranges;
+  jobs.settings = settings;
+  jobs.scratch = scratch;
+  workerPoolRunTemporary(workers, (unsigned)numranges, deflateRangeJob, &jobs);
+
+  for(i = 0; i < numranges && !error; i++)
+  {
+    size_t size = out->size;
+    error = scratch[i].error;
+    if(error || i == 0) continue;
+    if(!ucvector_resize(out, size + scratch[i].out.size)) error = 83; /*alloc fail*/
+    else memcpy(out->data + size, scratch[i].out.data, scratch[i].out.size);
   }
 
-  hash_cleanup(&hash);
+  return error;
+}
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+/*appends the deflated input to out, working in the given scratch buffers (one per thread)*/
+static unsigned deflateScratch(ucvector* out, const unsigned char* in, size_t insize,
+                               const LodePNGCompressSettings* settings,
+                               DeflateScratch* scratch, unsigned numscratch, WorkerPool* workers)
+{
+  (void)numscratch; /*only used for threads*/
+  (void)workers;
+  if(settings->btype > 2) return 61;
+  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
+#ifdef LODEPNG_COMPILE_THREADS
+  else if(settings->threads > 1 && numscratch > 1)
+    return deflateParallel(out, in, insize, settings, scratch,
+                           numscratch < settings->threads ? numscratch : settings->threads, workers);
+#endif /*LODEPNG_COMPILE_THREADS*/
+  else return deflateRange(out, in, 0, insize, settings, 1, &scratch[0]);
+}
+
+/*like deflateScratch, with scratch buffers that only live for this call*/
+static unsigned deflateTemporary(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings)
+{
+  unsigned i, error;
+  unsigned numscratch = settings->threads > 1 ? settings->threads : 1;
+  DeflateScratch* scratch = (DeflateScratch*)mymalloc(sizeof(DeflateScratch) * numscratch);
+  if(!scratch) return 83; /*alloc fail*/
+
+  for(i = 0; i < numscratch; i++) deflate_scratch_init(&scratch[i]);
+  error = deflateScratch(out, in, insize, settings, scratch, numscratch, 0);
+  for(i = 0; i < numscratch; i++) deflate_scratch_cleanup(&scratch[i]);
+  myfree(scratch);
 
   return error;
 }
@@ -2004,26 +2289,12 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
   unsigned error;
   ucvector v;
   ucvector_init_buffer(&v, *out, *outsize);
-  error = lodepng_deflatev(&v, in, insize, settings);
+  error = deflateTemporary(&v, in, insize, settings);
   *out = v.data;
   *outsize = v.size;
   return error;
 }
 
-static unsigned deflate(unsigned char** out, size_t* outsize,
-                        const unsigned char* in, size_t insize,
-                        const LodePNGCompressSettings* settings)
-{
-  if(settings->custom_deflate)
-  {
-    return settings->custom_deflate(out, outsize, in, insize, settings);
-  }
-  else
-  {
-    return lodepng_deflate(out, outsize, in, insize, settings);
-  }
-}
-
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -2123,18 +2394,16 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
-unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                               size_t insize, const LodePNGCompressSettings* settings)
+/*
+Appends the zlib stream of in to out. The built in deflate writes straight into out, using the
+scratch buffers if given and temporary ones otherwise.
+*/
+static unsigned zlibCompressScratch(ucvector* out, const unsigned char* in, size_t insize,
+                                    const LodePNGCompressSettings* settings,
+                                    DeflateScratch* scratch, unsigned numscratch, WorkerPool* workers)
 {
-  /*initially, *out must be NULL and outsize 0, if you just give some random *out
-  that's pointing to a non allocated buffer, this'll crash*/
-  ucvector outv;
-  size_t i;
   unsigned error;
-  unsigned char* deflatedata = 0;
-  size_t deflatesize = 0;
 
-  unsigned ADLER32;
   /*zlib data: 1 byte CMF (CM+CINFO), 1 byte FLG, deflate data, 4 byte ADLER32 checksum of the Decompressed data*/
   unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
   unsigned FLEVEL = 0;
@@ -2143,25 +2412,39 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
   unsigned FCHECK = 31 - CMFFLG % 31;
   CMFFLG += FCHECK;
 
-  /*ucvector-controlled version of the output buffer, for dynamic array*/
-  ucvector_init_buffer(&outv, *out, *outsize);
+  if(!ucvector_push_back(out, (unsigned char)(CMFFLG / 256))) return 83; /*alloc fail*/
+  if(!ucvector_push_back(out, (unsigned char)(CMFFLG % 256))) return 83; /*alloc fail*/
 
-  ucvector_push_back(&outv, (unsigned char)(CMFFLG / 256));
-  ucvector_push_back(&outv, (unsigned char)(CMFFLG % 256));
-
-  error = deflate(&deflatedata, &deflatesize, in, insize, settings);
-
-  if(!error)
+  if(settings->custom_deflate)
   {
-    ADLER32 = adler32(in, (unsigned)insize);
-    for(i = 0; i < deflatesize; i++) ucvector_push_back(&outv, deflatedata[i]);
-    free(deflatedata);
-    lodepng_add32bitInt(&outv, ADLER32);
+    unsigned char* deflatedata = 0;
+    size_t deflatesize = 0;
+    size_t size = out->size;
+    error = settings->custom_deflate(&deflatedata, &deflatesize, in, insize, settings);
+    if(!error && !ucvector_resize(out, size + deflatesize)) error = 83; /*alloc fail*/
+    if(!error) memcpy(out->data + size, deflatedata, deflatesize);
+    myfree(deflatedata);
   }
+  else if(scratch) error = deflateScratch(out, in, insize, settings, scratch, numscratch, workers);
+  else error = deflateTemporary(out, in, insize, settings);
 
+  if(!error) lodepng_add32bitInt(out, adler32(in, (unsigned)insize));
+
+  return error;
+}
+
+unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                               size_t insize, const LodePNGCompressSettings* settings)
+{
+  /*initially, *out must be NULL and outsize 0, if you just give some random *out
+  that's pointing to a non allocated buffer, this'll crash*/
+  unsigned error;
+  ucvector outv;
+  /*ucvector-controlled version of the output buffer, for dynamic array*/
+  ucvector_init_buffer(&outv, *out, *outsize);
+  error = zlibCompressScratch(&outv, in, insize, settings, 0, 0, 0);
   *out = outv.data;
   *outsize = outv.size;
-
   return error;
 }
 
@@ -2218,13 +2501,14 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->threads = 1;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 1, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -4828,11 +5112,110 @@ void lodepng_state_copy(LodePNGState* dest, const LodePNGState* source)
 /* / PNG Encoder                                                            / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
+/*the filter attempts of one range of scanlines, one for each filter type*/
+typedef struct FilterScratch
+{
+  ucvector attempt[5];
+  unsigned error; /*result of the range last filtered in this scratch*/
+} FilterScratch;
+
+struct LodePNGEncoderContext
+{
+  ucvector png; /*the last encoded PNG*/
+  ucvector converted; /*the image converted to the PNG color type, if it had to be*/
+  ucvector filtered; /*the filtered scanlines, the input of the zlib compressor*/
+  FilterScratch* filters;
+#ifdef LODEPNG_COMPILE_ZLIB
+  DeflateScratch* deflates;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  unsigned numscratch; /*number of filter and deflate scratch buffers, one per thread*/
+  WorkerPool* workers; /*numscratch - 1 helper threads, kept between images*/
+};
+
+LodePNGEncoderContext* lodepng_encoder_context_new(void)
+{
+  LodePNGEncoderContext* context = (LodePNGEncoderContext*)mymalloc(sizeof(LodePNGEncoderContext));
+  if(!context) return 0;
+  ucvector_init(&context->png);
+  ucvector_init(&context->converted);
+  ucvector_init(&context->filtered);
+  context->filters = 0;
+#ifdef LODEPNG_COMPILE_ZLIB
+  context->deflates = 0;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  context->numscratch = 0;
+  context->workers = 0;
+  return context;
+}
+
+void lodepng_encoder_context_delete(LodePNGEncoderContext* context)
+{
+  unsigned i, type;
+  if(!context) return;
+  ucvector_cleanup(&context->png);
+  ucvector_cleanup(&context->converted);
+  ucvector_cleanup(&context->filtered);
+  for(i = 0; i < context->numscratch; i++)
+  {
+    for(type = 0; type < 5; type++) ucvector_cleanup(&context->filters[i].attempt[type]);
+#ifdef LODEPNG_COMPILE_ZLIB
+    deflate_scratch_cleanup(&context->deflates[i]);
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  }
+  myfree(context->filters);
+#ifdef LODEPNG_COMPILE_ZLIB
+  myfree(context->deflates);
+#endif /*LODEPNG_COMPILE_ZLIB*/
+#ifdef LODEPNG_COMPILE_THREADS
+  workerPoolDelete(context->workers);
+#endif /*LODEPNG_COMPILE_THREADS*/
+  myfree(context);
+}
+
+/*makes sure the context has scratch buffers for the given number of threads*/
+static unsigned encoder_context_reserve(LodePNGEncoderContext* context, unsigned threads)
+{
+  unsigned i, type;
+  void* data;
+  if(threads < 1) threads = 1;
+  if(context->numscratch >= threads) return 0;
+
+  data = myrealloc(context->filters, sizeof(FilterScratch) * threads);
+  if(!data) return 83; /*alloc fail*/
+  context->filters = (FilterScratch*)data;
+#ifdef LODEPNG_COMPILE_ZLIB
+  data = myrealloc(context->deflates, sizeof(DeflateScratch) * threads);
+  if(!data) return 83; /*alloc fail*/
+  context->deflates = (DeflateScratch*)data;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+  for(i = context->numscratch; i < threads; i++)
+  {
+    for(type = 0; type < 5; type++) ucvector_init(&context->filters[i].attempt[type]);
+#ifdef LODEPNG_COMPILE_ZLIB
+    deflate_scratch_init(&context->deflates[i]);
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  }
+  context->numscratch = threads;
+
+#ifdef LODEPNG_COMPILE_THREADS
+  workerPoolDelete(context->workers);
+  context->workers = threads > 1 ? workerPoolNew(threads - 1) : 0;
+#endif /*LODEPNG_COMPILE_THREADS*/
+  return 0;
+}
+
 /*chunkName must be string of 4 characters*/
 static unsigned addChunk(ucvector* out, const char* chunkName, const unsigned char* data, size_t length)
 {
-  CERROR_TRY_RETURN(lodepng_chunk_create(&out->data, &out->size, (unsigned)length, chunkName, data));
-  out->allocsize = out->size; /*fix the allocsize again*/
+  size_t start = out->size;
+  if(start + length + 12 < length) return 77; /*integer overflow happened*/
+  if(!ucvector_resize(out, start + length + 12)) return 83; /*alloc fail*/
+
+  lodepng_set32bitInt(&out->data[start], (unsigned)length);
+  memcpy(&out->data[start + 4], chunkName, 4);
+  if(length) memcpy(&out->data[start + 8], data, length);
+  lodepng_chunk_generate_crc(&out->data[start]);
   return 0;
 }
 
@@ -4933,16 +5316,38 @@ static unsigned addChunk_tRNS(ucvector* out, const LodePNGColorMode* info)
 }
 
 static unsigned addChunk_IDAT(ucvector* out, const unsigned char* data, size_t datasize,
-                              LodePNGCompressSettings* zlibsettings)
+                              LodePNGCompressSettings* zlibsettings, LodePNGEncoderContext* context)
 {
-  ucvector zlibdata;
   unsigned error = 0;
+  (void)context; /*only used with the built in zlib*/
+#ifdef LODEPNG_COMPILE_ZLIB
+  if(!zlibsettings->custom_zlib)
+  {
+    /*compress straight into the chunk, then fill in its length and CRC*/
+    size_t start = out->size;
+    if(!ucvector_resize(out, start + 8)) return 83; /*alloc fail*/
+    memcpy(&out->data[start + 4], "IDAT", 4);
+
+    if(context) error = zlibCompressScratch(out, data, datasize, zlibsettings, context->deflates, context->numscratch,
+                                            context->workers);
+    else error = zlibCompressScratch(out, data, datasize, zlibsettings, 0, 0, 0);
+    if(error) return error;
+
+    lodepng_set32bitInt(&out->data[start], (unsigned)(out->size - start - 8));
+    if(!ucvector_resize(out, out->size + 4)) return 83; /*alloc fail*/
+    lodepng_chunk_generate_crc(&out->data[start]);
+    return 0;
+  }
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  {
+    ucvector zlibdata;
 
-  /*compress with the Zlib compressor*/
-  ucvector_init(&zlibdata);
-  error = zlib_compress(&zlibdata.data, &zlibdata.size, data, datasize, zlibsettings);
-  if(!error) error = addChunk(out, "IDAT", zlibdata.data, zlibdata.size);
-  ucvector_cleanup(&zlibdata);
+    /*compress with the Zlib compressor*/
+    ucvector_init(&zlibdata);
+    error = zlib_compress(&zlibdata.data, &zlibdata.size, data, datasize, zlibsettings);
+    if(!error) error = addChunk(out, "IDAT", zlibdata.data, zlibdata.size);
+    ucvector_cleanup(&zlibdata);
+  }
 
   return error;
 }
@@ -5178,8 +5583,11 @@ static float flog2(float f)
   return result + 1.442695f * (f * f * f / 3 - 3 * f * f / 2 + 3 * f - 1.83333f);
 }
 
-static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
-                       const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
+/*filters scanlines ystart..yend-1 of the image. Every row only depends on the unfiltered row
+above it, so disjoint ranges can be filtered independently*/
+static unsigned filterRange(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                            unsigned ystart, unsigned yend, ucvector* attempt /*five, one for each filter type*/,
+                            const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
 {
   /*
   For PNG filter method 0
@@ -5192,7 +5600,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   size_t linebytes = (w * bpp + 7) / 8;
   /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
   size_t bytewidth = (bpp + 7) / 8;
-  const unsigned char* prevline = 0;
+  const unsigned char* prevline = ystart ? &in[(ystart - 1) * linebytes] : 0;
   unsigned x, y;
   unsigned error = 0;
   LodePNGFilterStrategy strategy = settings->filter_strategy;
@@ -5215,14 +5623,15 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 
   if(bpp == 0) return 31; /*error: invalid color type*/
 
-  if(strategy == LFS_ZERO)
+  if(strategy <= LFS_FOUR)
   {
-    for(y = 0; y < h; y++)
+    unsigned type = (unsigned)strategy;
+    for(y = ystart; y < yend; y++)
     {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
-      out[outindex] = 0; /*filter type byte*/
-      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, 0);
+      out[outindex] = type; /*filter type byte*/
+      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
       prevline = &in[inindex];
     }
   }
@@ -5230,19 +5639,17 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   {
     /*adaptive filtering*/
     size_t sum[5];
-    ucvector attempt[5]; /*five filtering attempts, one for each filter type*/
     size_t smallest = 0;
     unsigned type, bestType = 0;
 
     for(type = 0; type < 5; type++)
     {
-      ucvector_init(&attempt[type]);
       if(!ucvector_resize(&attempt[type], linebytes)) return 83; /*alloc fail*/
     }
 
     if(!error)
     {
-      for(y = 0; y < h; y++)
+      for(y = ystart; y < yend; y++)
       {
         /*try the 5 filter types*/
         for(type = 0; type < 5; type++)
@@ -5283,23 +5690,20 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       }
     }
 
-    for(type = 0; type < 5; type++) ucvector_cleanup(&attempt[type]);
   }
   else if(strategy == LFS_ENTROPY)
   {
     float sum[5];
-    ucvector attempt[5]; /*five filtering attempts, one for each filter type*/
     float smallest = 0;
     unsigned type, bestType = 0;
     unsigned count[256];
 
     for(type = 0; type < 5; type++)
     {
-      ucvector_init(&attempt[type]);
       if(!ucvector_resize(&attempt[type], linebytes)) return 83; /*alloc fail*/
     }
 
-    for(y = 0; y < h; y++)
+    for(y = ystart; y < yend; y++)
     {
       /*try the 5 filter types*/
       for(type = 0; type < 5; type++)
@@ -5329,11 +5733,10 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       for(x = 0; x < linebytes; x++) out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
     }
 
-    for(type = 0; type < 5; type++) ucvector_cleanup(&attempt[type]);
   }
   else if(strategy == LFS_PREDEFINED)
   {
-    for(y = 0; y < h; y++)
+    for(y = ystart; y < yend; y++)
     {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
@@ -5349,7 +5752,6 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     deflate the scanline after every filter attempt to see which one deflates best.
     This is very slow and gives only slightly smaller, sometimes even larger, result*/
     size_t size[5];
-    ucvector attempt[5]; /*five filtering attempts, one for each filter type*/
     size_t smallest = 0;
     unsigned type = 0, bestType = 0;
     unsigned char* dummy;
@@ -5365,10 +5767,9 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     zlibsettings.custom_deflate = 0;
     for(type = 0; type < 5; type++)
     {
-      ucvector_init(&attempt[type]);
-      ucvector_resize(&attempt[type], linebytes); /*todo: give error if resize failed*/
+      if(!ucvector_resize(&attempt[type], linebytes)) return 83; /*alloc fail*/
     }
-    for(y = 0; y < h; y++) /*try the 5 filter types*/
+    for(y = ystart; y < yend; y++) /*try the 5 filter types*/
     {
       for(type = 0; type < 5; type++)
       {
@@ -5391,13 +5792,95 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
       for(x = 0; x < linebytes; x++) out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
     }
-    for(type = 0; type < 5; type++) ucvector_cleanup(&attempt[type]);
   }
   else return 88; /* unknown filter strategy */
 
   return error;
 }
 
+#ifdef LODEPNG_COMPILE_THREADS
+/*below this many scanlines per thread, filtering is not worth splitting up*/
+static const unsigned MIN_PARALLEL_FILTER_ROWS = 64;
+
+/*one filterScratch call, shared by the jobs of its ranges*/
+typedef struct FilterJobs
+{
+  unsigned char* out;
+  const unsigned char* in;
+  unsigned w, h;
+  unsigned rangesize;
+  FilterScratch* scratch;
+  const LodePNGColorMode* info;
+  const LodePNGEncoderSettings* settings;
+} FilterJobs;
+
+static void filterRangeJob(void* arg, unsigned index)
+{
+  FilterJobs* jobs = (FilterJobs*)arg;
+  unsigned ystart = index * jobs->rangesize;
+  unsigned yend = ystart + jobs->rangesize < jobs->h ? ystart + jobs->rangesize : jobs->h;
+
+  jobs->scratch[index].error = filterRange(jobs->out, jobs->in, jobs->w, jobs->h, ystart, yend,
+                                           jobs->scratch[index].attempt, jobs->info, jobs->settings);
+}
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+/*
+Filters the image on up to numscratch threads, each working in its own scratch. The helper
+threads come from workers, or only live for this call if it is NULL.
+*/
+static unsigned filterScratch(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                              const LodePNGColorMode* info, const LodePNGEncoderSettings* settings,
+                              FilterScratch* scratch, unsigned numscratch, WorkerPool* workers)
+{
+  (void)numscratch; /*only used for threads*/
+  (void)workers;
+#ifdef LODEPNG_COMPILE_THREADS
+  unsigned i, error = 0, numranges = h / MIN_PARALLEL_FILTER_ROWS;
+  if(numranges > settings->zlibsettings.threads) numranges = settings->zlibsettings.threads;
+  if(numranges > numscratch) numranges = numscratch;
+  if(numranges > 1)
+  {
+    FilterJobs jobs;
+    jobs.out = out;
+    jobs.in = in;
+    jobs.w = w;
+    jobs.h = h;
+    jobs.rangesize = (h + numranges - 1) / numranges;
+    jobs.scratch = scratch;
+    jobs.info = info;
+    jobs.settings = settings;
+    workerPoolRunTemporary(workers, numranges, filterRangeJob, &jobs);
+
+    for(i = 0; i < numranges && !error; i++) error = scratch[i].error;
+    return error;
+  }
+#endif /*LODEPNG_COMPILE_THREADS*/
+  return filterRange(out, in, w, h, 0, h, scratch[0].attempt, info, settings);
+}
+
+/*filters with the context's scratch, or with scratch that only lives for this call if there is none*/
+static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                       const LodePNGColorMode* info, const LodePNGEncoderSettings* settings,
+                       LodePNGEncoderContext* context)
+{
+  unsigned i, type, error;
+  unsigned numscratch = settings->zlibsettings.threads > 1 ? settings->zlibsettings.threads : 1;
+  FilterScratch* scratch;
+
+  if(context) return filterScratch(out, in, w, h, info, settings, context->filters, context->numscratch,
+                                   context->workers);
+
+  scratch = (FilterScratch*)mymalloc(sizeof(FilterScratch) * numscratch);
+  if(!scratch) return 83; /*alloc fail*/
+  for(i = 0; i < numscratch; i++) for(type = 0; type < 5; type++) ucvector_init(&scratch[i].attempt[type]);
+  error = filterScratch(out, in, w, h, info, settings, scratch, numscratch, 0);
+  for(i = 0; i < numscratch; i++) for(type = 0; type < 5; type++) ucvector_cleanup(&scratch[i].attempt[type]);
+  myfree(scratch);
+
+  return error;
+}
+
 static void addPaddingBits(unsigned char* out, const unsigned char* in,
                            size_t olinebits, size_t ilinebits, unsigned h)
 {
@@ -5482,9 +5965,11 @@ static void Adam7_interlace(unsigned char* out, const unsigned char* in, unsigne
 
 /*out must be buffer big enough to contain uncompressed IDAT chunk data, and in must contain the full image.
 return value is error**/
+/*the output is allocated, or kept in the context's filtered buffer if there is a context*/
 static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const unsigned char* in,
                                     unsigned w, unsigned h,
-                                    const LodePNGInfo* info_png, const LodePNGEncoderSettings* settings)
+                                    const LodePNGInfo* info_png, const LodePNGEncoderSettings* settings,
+                                    LodePNGEncoderContext* context)
 {
   /*
   This function converts the pure 2D image with the PNG's colortype, into filtered-padded-interlaced data. Steps:
@@ -5497,7 +5982,8 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
   if(info_png->interlace_method == 0)
   {
     *outsize = h + (h * ((w * bpp + 7) / 8)); /*image size plus an extra byte per scanline + possible padding bits*/
-    *out = (unsigned char*)mymalloc(*outsize);
+    if(context) *out = ucvector_resize(&context->filtered, *outsize) ? context->filtered.data : 0;
+    else *out = (unsigned char*)mymalloc(*outsize);
     if(!(*out) && (*outsize)) error = 83; /*alloc fail*/
 
     if(!error)
@@ -5510,14 +5996,14 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
         if(!error)
         {
           addPaddingBits(padded, in, ((w * bpp + 7) / 8) * 8, w * bpp, h);
-          error = filter(*out, padded, w, h, &info_png->color, settings);
+          error = filter(*out, padded, w, h, &info_png->color, settings, context);
         }
         myfree(padded);
       }
       else
       {
         /*we can immediatly filter into the out buffer, no other steps needed*/
-        error = filter(*out, in, w, h, &info_png->color, settings);
+        error = filter(*out, in, w, h, &info_png->color, settings, context);
       }
     }
   }
@@ -5530,7 +6016,8 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
     Adam7_getpassvalues(passw, passh, filter_passstart, padded_passstart, passstart, w, h, bpp);
 
     *outsize = filter_passstart[7]; /*image size plus an extra byte per scanline + possible padding bits*/
-    *out = (unsigned char*)mymalloc(*outsize);
+    if(context) *out = ucvector_resize(&context->filtered, *outsize) ? context->filtered.data : 0;
+    else *out = (unsigned char*)mymalloc(*outsize);
     if(!(*out)) error = 83; /*alloc fail*/
 
     adam7 = (unsigned char*)mymalloc(passstart[7]);
@@ -5550,13 +6037,13 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
           addPaddingBits(padded, &adam7[passstart[i]],
                          ((passw[i] * bpp + 7) / 8) * 8, passw[i] * bpp, passh[i]);
           error = filter(&(*out)[filter_passstart[i]], padded,
-                         passw[i], passh[i], &info_png->color, settings);
+                         passw[i], passh[i], &info_png->color, settings, context);
           myfree(padded);
         }
         else
         {
           error = filter(&(*out)[filter_passstart[i]], &adam7[padded_passstart[i]],
-                         passw[i], passh[i], &info_png->color, settings);
+                         passw[i], passh[i], &info_png->color, settings, context);
         }
 
         if(error) break;
@@ -5608,18 +6095,14 @@ static unsigned addUnknownChunks(ucvector* out, unsigned char* data, size_t data
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-unsigned lodepng_encode(unsigned char** out, size_t* outsize,
-                        const unsigned char* image, unsigned w, unsigned h,
-                        LodePNGState* state)
+/*appends the PNG to outv. With a context, its scratch buffers are used instead of allocating*/
+static unsigned encodePNG(ucvector* outv, const unsigned char* image, unsigned w, unsigned h,
+                          LodePNGState* state, LodePNGEncoderContext* context)
 {
   LodePNGInfo info;
-  ucvector outv;
   unsigned char* data = 0; /*uncompressed version of the IDAT chunk data*/
   size_t datasize = 0;
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
-  *outsize = 0;
   state->error = 0;
 
   lodepng_info_init(&info);
@@ -5662,72 +6145,72 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
     unsigned char* converted;
     size_t size = (w * h * lodepng_get_bpp(&info.color) + 7) / 8;
 
-    converted = (unsigned char*)mymalloc(size);
+    if(context) converted = ucvector_resize(&context->converted, size) ? context->converted.data : 0;
+    else converted = (unsigned char*)mymalloc(size);
     if(!converted && size) state->error = 83; /*alloc fail*/
     if(!state->error)
     {
       state->error = lodepng_convert(converted, image, &info.color, &state->info_raw, w, h);
     }
-    if(!state->error) preProcessScanlines(&data, &datasize, converted, w, h, &info, &state->encoder);
-    myfree(converted);
+    if(!state->error) preProcessScanlines(&data, &datasize, converted, w, h, &info, &state->encoder, context);
+    if(!context) myfree(converted);
   }
-  else preProcessScanlines(&data, &datasize, image, w, h, &info, &state->encoder);
+  else preProcessScanlines(&data, &datasize, image, w, h, &info, &state->encoder, context);
 
-  ucvector_init(&outv);
   while(!state->error) /*while only executed once, to break on error*/
   {
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     size_t i;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     /*write signature and chunks*/
-    writeSignature(&outv);
+    writeSignature(outv);
     /*IHDR*/
-    addChunk_IHDR(&outv, w, h, info.color.colortype, info.color.bitdepth, info.interlace_method);
+    addChunk_IHDR(outv, w, h, info.color.colortype, info.color.bitdepth, info.interlace_method);
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     /*unknown chunks between IHDR and PLTE*/
     if(info.unknown_chunks_data[0])
     {
-      state->error = addUnknownChunks(&outv, info.unknown_chunks_data[0], info.unknown_chunks_size[0]);
+      state->error = addUnknownChunks(outv, info.unknown_chunks_data[0], info.unknown_chunks_size[0]);
       if(state->error) break;
     }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     /*PLTE*/
     if(info.color.colortype == LCT_PALETTE)
     {
-      addChunk_PLTE(&outv, &info.color);
+      addChunk_PLTE(outv, &info.color);
     }
     if(state->encoder.force_palette && (info.color.colortype == LCT_RGB || info.color.colortype == LCT_RGBA))
     {
-      addChunk_PLTE(&outv, &info.color);
+      addChunk_PLTE(outv, &info.color);
     }
     /*tRNS*/
     if(info.color.colortype == LCT_PALETTE && getPaletteTranslucency(info.color.palette, info.color.palettesize) != 0)
     {
-      addChunk_tRNS(&outv, &info.color);
+      addChunk_tRNS(outv, &info.color);
     }
     if((info.color.colortype == LCT_GREY || info.color.colortype == LCT_RGB) && info.color.key_defined)
     {
-      addChunk_tRNS(&outv, &info.color);
+      addChunk_tRNS(outv, &info.color);
     }
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     /*bKGD (must come between PLTE and the IDAt chunks*/
-    if(info.background_defined) addChunk_bKGD(&outv, &info);
+    if(info.background_defined) addChunk_bKGD(outv, &info);
     /*pHYs (must come before the IDAT chunks)*/
-    if(info.phys_defined) addChunk_pHYs(&outv, &info);
+    if(info.phys_defined) addChunk_pHYs(outv, &info);
 
     /*unknown chunks between PLTE and IDAT*/
     if(info.unknown_chunks_data[1])
     {
-      state->error = addUnknownChunks(&outv, info.unknown_chunks_data[1], info.unknown_chunks_size[1]);
+      state->error = addUnknownChunks(outv, info.unknown_chunks_data[1], info.unknown_chunks_size[1]);
       if(state->error) break;
     }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     /*IDAT (multiple IDAT chunks must be consecutive)*/
-    state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings);
+    state->error = addChunk_IDAT(outv, data, datasize, &state->encoder.zlibsettings, context);
     if(state->error) break;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     /*tIME*/
-    if(info.time_defined) addChunk_tIME(&outv, &info.time);
+    if(info.time_defined) addChunk_tIME(outv, &info.time);
     /*tEXt and/or zTXt*/
     for(i = 0; i < info.text_num; i++)
     {
@@ -5742,9 +6225,9 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
         break;
       }
       if(state->encoder.text_compression)
-        addChunk_zTXt(&outv, info.text_keys[i], info.text_strings[i], &state->encoder.zlibsettings);
+        addChunk_zTXt(outv, info.text_keys[i], info.text_strings[i], &state->encoder.zlibsettings);
       else
-        addChunk_tEXt(&outv, info.text_keys[i], info.text_strings[i]);
+        addChunk_tEXt(outv, info.text_keys[i], info.text_strings[i]);
     }
     /*LodePNG version id in text chunk*/
     if(state->encoder.add_id)
@@ -5759,7 +6242,7 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
         }
       }
       if(alread_added_id_text == 0)
-        addChunk_tEXt(&outv, "LodePNG", VERSION_STRING); /*it's shorter as tEXt than as zTXt chunk*/
+        addChunk_tEXt(outv, "LodePNG", VERSION_STRING); /*it's shorter as tEXt than as zTXt chunk*/
     }
     /*iTXt*/
     for(i = 0; i < info.itext_num; i++)
@@ -5774,7 +6257,7 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
         state->error = 67; /*text chunk too small*/
         break;
       }
-      addChunk_iTXt(&outv, state->encoder.text_compression,
+      addChunk_iTXt(outv, state->encoder.text_compression,
                     info.itext_keys[i], info.itext_langtags[i], info.itext_transkeys[i], info.itext_strings[i],
                     &state->encoder.zlibsettings);
     }
@@ -5782,25 +6265,64 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
     /*unknown chunks between IDAT and IEND*/
     if(info.unknown_chunks_data[2])
     {
-      state->error = addUnknownChunks(&outv, info.unknown_chunks_data[2], info.unknown_chunks_size[2]);
+      state->error = addUnknownChunks(outv, info.unknown_chunks_data[2], info.unknown_chunks_size[2]);
       if(state->error) break;
     }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     /*IEND*/
-    addChunk_IEND(&outv);
+    addChunk_IEND(outv);
 
     break; /*this isn't really a while loop; no error happened so break out now!*/
   }
 
   lodepng_info_cleanup(&info);
-  myfree(data);
+  if(!context) myfree(data);
+
+  return state->error;
+}
+
+unsigned lodepng_encode(unsigned char** out, size_t* outsize,
+                        const unsigned char* image, unsigned w, unsigned h,
+                        LodePNGState* state)
+{
+  ucvector outv;
+  ucvector_init(&outv);
+  encodePNG(&outv, image, w, h, state, 0);
   /*instead of cleaning the vector up, give it to the output*/
   *out = outv.data;
   *outsize = outv.size;
+  return state->error;
+}
+
+unsigned lodepng_encode_context(const unsigned char** out, size_t* outsize,
+                                const unsigned char* image, unsigned w, unsigned h,
+                                LodePNGState* state, LodePNGEncoderContext* context)
+{
+  *out = 0;
+  *outsize = 0;
+  state->error = encoder_context_reserve(context, state->encoder.zlibsettings.threads);
+  if(state->error) return state->error;
 
+  context->png.size = 0;
+  if(!encodePNG(&context->png, image, w, h, state, context))
+  {
+    *out = context->png.data;
+    *outsize = context->png.size;
+  }
   return state->error;
 }
 
+unsigned lodepng_encode_buffer(unsigned char* out, size_t capacity, size_t* outsize,
+                               const unsigned char* image, unsigned w, unsigned h,
+                               LodePNGState* state, LodePNGEncoderContext* context)
+{
+  const unsigned char* png;
+  if(lodepng_encode_context(&png, outsize, image, w, h, state, context)) return state->error;
+  if(*outsize > capacity) CERROR_RETURN_ERROR(state->error, 90); /*output buffer too small*/
+  memcpy(out, png, *outsize);
+  return 0;
+}
+
 unsigned lodepng_encode_memory(unsigned char** out, size_t* outsize, const unsigned char* image,
                                unsigned w, unsigned h, LodePNGColorType colortype, unsigned bitdepth)
 {
@@ -5848,6 +6370,26 @@ unsigned lodepng_encode24_file(const char* filename, const unsigned char* image,
 {
   return lodepng_encode_file(filename, image, w, h, LCT_RGB, 8);
 }
+
+unsigned lodepng_encode_fd(int fd, const unsigned char* image, unsigned w, unsigned h,
+                           LodePNGState* state, LodePNGEncoderContext* context)
+{
+  const unsigned char* png;
+  size_t size;
+  if(lodepng_encode_context(&png, &size, image, w, h, state, context)) return state->error;
+  while(size > 0)
+  {
+#ifdef _WIN32
+    int written = _write(fd, png, size > 0x40000000 ? 0x40000000 : (unsigned)size);
+#else
+    ssize_t written = write(fd, png, size);
+#endif
+    if(written <= 0) CERROR_RETURN_ERROR(state->error, 91); /*write failed*/
+    png += written;
+    size -= written;
+  }
+  return 0;
+}
 #endif /*LODEPNG_COMPILE_DISK*/
 
 void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings)
@@ -5864,6 +6406,14 @@ void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings)
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 }
 
+void lodepng_encoder_settings_fast(LodePNGEncoderSettings* settings)
+{
+  settings->filter_strategy = LFS_FOUR;
+  settings->zlibsettings.windowsize = 512;
+  settings->zlibsettings.nicematch = 32;
+  settings->zlibsettings.lazymatching = 0;
+}
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_PNG*/
 
@@ -5969,6 +6519,8 @@ const char* lodepng_error_text(unsigned code)
     case 87: return "must provide custom zlib function pointer if LODEPNG_COMPILE_ZLIB is not defined";
     case 88: return "invalid filter strategy given for LodePNGEncoderSettings.filter_strategy";
     case 89: return "text chunk keyword too short or long: must have size 1-79";
+    case 90: return "encoded image does not fit in the given output buffer";
+    case 91: return "failed to write to file descriptor";
   }
   return "unknown error code";
 }
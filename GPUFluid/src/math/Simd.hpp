@@ -0,0 +1,45 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef MATH_SIMD_HPP_
+#define MATH_SIMD_HPP_
+
+/* Selects the vector unit used by the math library at compile time.
+ * Define MATH_NO_SIMD to force the scalar implementations. */
+#if !defined(MATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATH_SSE 1
+#include <emmintrin.h>
+#if defined(__AVX__)
+#define MATH_AVX 1
+#include <immintrin.h>
+#endif
+#endif
+
+#ifndef MATH_SSE
+#define MATH_SSE 0
+#endif
+#ifndef MATH_AVX
+#define MATH_AVX 0
+#endif
+
+#endif
@@ -39,66 +39,6 @@ Vec3 powf(const Vec3 &v, float p) {
     );
 }
 
-Vec3 operator-(const Vec3 &a) {
-    return Vec3(-a.x, -a.y, -a.z);
-}
-
-Vec3 operator+(const Vec3 &a, const Vec3 &b) {
-    return Vec3(a.x + b.x, a.y + b.y, a.z + b.z);
-}
-
-Vec3 operator-(const Vec3 &a, const Vec3 &b) {
-    return Vec3(a.x - b.x, a.y - b.y, a.z - b.z);
-}
-
-Vec3 operator*(const Vec3 &a, const Vec3 &b) {
-    return Vec3(a.x*b.x, a.y*b.y, a.z*b.z);
-}
-
-Vec3 operator/(const Vec3 &a, const Vec3 &b) {
-    return Vec3(a.x/b.x, a.y/b.y, a.z/b.z);
-}
-
-Vec3 operator*(const Vec3 &a, float b) {
-    return Vec3(a.x*b, a.y*b, a.z*b);
-}
-
-Vec3 operator*(float a, const Vec3 &b) {
-    return Vec3(a*b.x, a*b.y, a*b.z);
-}
-
-Vec3 operator/(const Vec3 &a, float b) {
-    return Vec3(a.x/b, a.y/b, a.z/b);
-}
-
-Vec3 operator/(float a, const Vec3 &b) {
-    return Vec3(a/b.x, a/b.y, a/b.z);
-}
-
-bool operator>(const Vec3 &a, const Vec3 &b) {
-    return a.x > b.x && a.y > b.y && a.z > b.z;
-}
-
-bool operator<(const Vec3 &a, const Vec3 &b) {
-    return a.x < b.x && a.y < b.y && a.z < b.z;
-}
-
-bool operator>=(const Vec3 &a, const Vec3 &b) {
-    return a.x >= b.x && a.y >= b.y && a.z >= b.z;
-}
-
-bool operator<=(const Vec3 &a, const Vec3 &b) {
-    return a.x <= b.x && a.y <= b.y && a.z <= b.z;
-}
-
-bool operator==(const Vec3 &a, const Vec3 &b) {
-    return a.x == b.x && a.y == b.y && a.z == b.z;
-}
-
-bool operator!=(const Vec3 &a, const Vec3 &b) {
-    return a.x != b.x || a.y != b.y || a.z != b.z;
-}
-
 std::ostream &operator<<(std::ostream &os, const Vec3 &v) {
     return os << "(" << v.x << ", " << v.y << ", " << v.z << ")";
 }
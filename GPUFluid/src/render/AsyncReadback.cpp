@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include <GL/glew.h>
+#include <string.h>
+
+#include "AsyncReadback.hpp"
+#include "Texture.hpp"
+#include "Debug.hpp"
+
+AsyncReadback::AsyncReadback(GLsizeiptr size, int regionCount) :
+        _buffer(PIXEL_PACK_BUFFER), _regionCount(regionCount), _head(0), _pending(0), _hasLatest(false) {
+    ASSERT(regionCount <= MaxRegions, "Too many readback regions: %d\n", regionCount);
+
+    _regionSize = (size + 15)/16*16;
+    _latest = new unsigned char[_regionSize];
+
+    for (int i = 0; i < MaxRegions; i++)
+        _fences[i] = 0;
+
+    int flags = MAP_READ | MAP_PERSISTENT | MAP_COHERENT;
+
+    _buffer.initStorage(_regionSize*_regionCount, flags);
+    _buffer.bind();
+    _buffer.mapRange(0, _regionSize*_regionCount, flags);
+    _buffer.unbind();
+
+    _base = (unsigned char *)_buffer.data();
+}
+
+AsyncReadback::~AsyncReadback() {
+    for (int i = 0; i < _regionCount; i++)
+        if (_fences[i])
+            glDeleteSync(_fences[i]);
+
+    _buffer.bind();
+    _buffer.unmap();
+    _buffer.unbind();
+
+    delete[] _latest;
+}
+
+void AsyncReadback::beginRead() {
+    if (_pending == _regionCount)
+        retireOldest(true);
+}
+
+void AsyncReadback::endRead() {
+    _fences[_head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    _head = (_head + 1) % _regionCount;
+    _pending++;
+}
+
+void AsyncReadback::retireOldest(bool wait) {
+    int oldest = (_head - _pending + _regionCount) % _regionCount;
+
+    if (wait)
+        while (glClientWaitSync(_fences[oldest], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(_fences[oldest]);
+    _fences[oldest] = 0;
+
+    memcpy(_latest, _base + oldest*_regionSize, _regionSize);
+    _hasLatest = true;
+    _pending--;
+}
+
+void AsyncReadback::readTexture(Texture &src, GLenum format, GLenum type) {
+    ASSERT(src.size() <= (unsigned long long)_regionSize, "Texture does not fit a readback region\n");
+
+    /* src may have been written through image stores */
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+    beginRead();
+    _buffer.bind();
+    src.read((void *)(_head*_regionSize), format, type);
+    _buffer.unbind();
+    endRead();
+}
+
+/* Retires every read that has completed, oldest first. Returns whether any
+ * result is available at all */
+bool AsyncReadback::poll() {
+    while (_pending) {
+        int oldest = (_head - _pending + _regionCount) % _regionCount;
+        GLenum status = glClientWaitSync(_fences[oldest], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+            break;
+        retireOldest(false);
+    }
+
+    return _hasLatest;
+}
+
+void AsyncReadback::finish() {
+    while (_pending)
+        retireOldest(true);
+}
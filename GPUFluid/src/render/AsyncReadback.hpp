@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef RENDER_ASYNCREADBACK_HPP_
+#define RENDER_ASYNCREADBACK_HPP_
+
+#include <GL/glew.h>
+
+#include "BufferObject.hpp"
+
+class Texture;
+
+/* Brings small GPU results back a frame or two late instead of stalling on
+ * them. Each read goes into its own region of a persistently mapped buffer
+ * and is fenced; poll() picks up whatever has completed without waiting.
+ * Only a read issued while every region is still in flight blocks. */
+class AsyncReadback {
+    static const int MaxRegions = 4;
+
+    BufferObject _buffer;
+    unsigned char *_base;
+
+    GLsync _fences[MaxRegions];
+    int _regionCount;
+    GLsizeiptr _regionSize;
+
+    int _head;
+    int _pending;
+
+    /* Copied out on retirement, since the region may be read into again */
+    unsigned char *_latest;
+    bool _hasLatest;
+
+    void beginRead();
+    void endRead();
+    void retireOldest(bool wait);
+
+public:
+    AsyncReadback(GLsizeiptr size, int regionCount = 3);
+    ~AsyncReadback();
+
+    void readTexture(Texture &src, GLenum format, GLenum type);
+
+    bool poll();
+    void finish();
+
+    bool pending() const {
+        return _pending > 0;
+    }
+
+    /* Most recently completed read, or NULL if none has completed yet */
+    const void *latest() const {
+        return _hasLatest ? _latest : 0;
+    }
+};
+
+#endif /* RENDER_ASYNCREADBACK_HPP_ */
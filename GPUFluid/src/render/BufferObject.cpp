@@ -33,8 +33,29 @@ static GLenum bufferTypes[] = {
     GL_PIXEL_UNPACK_BUFFER,
     GL_SHADER_STORAGE_BUFFER,
     GL_UNIFORM_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER,
 };
 
+static GLbitfield mapFlagBits(int flags) {
+    const GLenum flagBits[] = {
+        GL_MAP_READ_BIT,
+        GL_MAP_WRITE_BIT,
+        GL_MAP_INVALIDATE_RANGE_BIT,
+        GL_MAP_INVALIDATE_BUFFER_BIT,
+        GL_MAP_FLUSH_EXPLICIT_BIT,
+        GL_MAP_UNSYNCHRONIZED_BIT,
+        GL_MAP_PERSISTENT_BIT,
+        GL_MAP_COHERENT_BIT,
+    };
+
+    GLbitfield glFlags = 0;
+    for (int i = 0; i < 8; i++)
+        if (flags & (1 << i))
+            glFlags |= flagBits[i];
+
+    return glFlags;
+}
+
 BufferObject::BufferObject(BufferType type) : _type(type), _size(-1), _data(0) {
     _glType = bufferTypes[type];
 
@@ -55,6 +76,14 @@ void BufferObject::init(GLsizei size) {
     unbind();
 }
 
+/* Immutable storage, so it can stay mapped while the GPU reads from it */
+void BufferObject::initStorage(GLsizei size, int flags) {
+    _size = size;
+    bind();
+    glBufferStorage(_glType, _size, NULL, mapFlagBits(flags & (MAP_READ | MAP_WRITE | MAP_PERSISTENT | MAP_COHERENT)));
+    unbind();
+}
+
 BufferObject::~BufferObject() {
     glDeleteBuffers(1, &_glName);
 }
@@ -69,21 +98,7 @@ void BufferObject::map(int flags) {
 }
 
 void BufferObject::mapRange(GLintptr offset, GLsizeiptr length, int flags) {
-    const GLenum flagBits[] = {
-        GL_MAP_READ_BIT,
-        GL_MAP_WRITE_BIT,
-        GL_MAP_INVALIDATE_RANGE_BIT,
-        GL_MAP_INVALIDATE_BUFFER_BIT,
-        GL_MAP_FLUSH_EXPLICIT_BIT,
-        GL_MAP_UNSYNCHRONIZED_BIT,
-    };
-
-    GLbitfield glFlags = 0;
-    for (int i = 0; i < 6; i++)
-        if (flags & (1 << i))
-            glFlags |= flagBits[i];
-
-    glMapBufferRange(_glType, offset, length, glFlags);
+    _data = glMapBufferRange(_glType, offset, length, mapFlagBits(flags));
 }
 
 void BufferObject::unmap() {
@@ -95,6 +110,10 @@ void BufferObject::copyData(void *data, GLsizei size, GLenum usage) {
     glBufferData(_glType, size, data, usage);
 }
 
+void BufferObject::copySubData(const void *data, GLintptr offset, GLsizeiptr size) {
+    glBufferSubData(_glType, offset, size, data);
+}
+
 void BufferObject::bind() {
     glBindBuffer(_glType, _glName);
 }
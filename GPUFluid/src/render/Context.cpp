@@ -0,0 +1,161 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include <GL/glew.h>
+#ifdef _WIN32
+#include <GL/wglew.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glx.h>
+#endif
+
+#include "Context.hpp"
+#include "Debug.hpp"
+
+#ifdef _WIN32
+Context::Context(bool share) : _glx(false) {
+    const int attribs[] = {
+        WGL_CONTEXT_MAJOR_VERSION_ARB, 4,
+        WGL_CONTEXT_MINOR_VERSION_ARB, 5,
+        WGL_CONTEXT_PROFILE_MASK_ARB, WGL_CONTEXT_CORE_PROFILE_BIT_ARB,
+        0
+    };
+
+    HDC dc = wglGetCurrentDC();
+    ASSERT(dc != NULL, "Worker contexts need a current window context\n");
+
+    _display = dc;
+    _context = wglCreateContextAttribsARB(dc, share ? wglGetCurrentContext() : NULL, attribs);
+    ASSERT(_context != NULL, "Unable to create worker context\n");
+}
+
+Context::~Context() {
+    wglDeleteContext((HGLRC)_context);
+}
+
+void Context::makeCurrent() {
+    wglMakeCurrent((HDC)_display, (HGLRC)_context);
+}
+
+void Context::release() {
+    wglMakeCurrent(NULL, NULL);
+}
+#else
+/* freeglut windows on X11 own GLX contexts, which EGL cannot share with */
+static GLXContext createGlxContext(Display *display, GLXContext share) {
+    int configId = 0;
+    glXQueryContext(display, share, GLX_FBCONFIG_ID, &configId);
+
+    const int configAttribs[] = {GLX_FBCONFIG_ID, configId, None};
+    int configCount = 0;
+    GLXFBConfig *configs = glXChooseFBConfig(display, DefaultScreen(display), configAttribs, &configCount);
+    ASSERT(configs != NULL && configCount > 0, "Unable to find the framebuffer config of the shared context\n");
+
+    PFNGLXCREATECONTEXTATTRIBSARBPROC createContextAttribs = (PFNGLXCREATECONTEXTATTRIBSARBPROC)
+        glXGetProcAddress((const GLubyte *)"glXCreateContextAttribsARB");
+    ASSERT(createContextAttribs != NULL, "GLX_ARB_create_context is not supported\n");
+
+    const int attribs[] = {
+        GLX_CONTEXT_MAJOR_VERSION_ARB, 4,
+        GLX_CONTEXT_MINOR_VERSION_ARB, 5,
+        GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+        None
+    };
+
+    GLXContext context = createContextAttribs(display, configs[0], share, True, attribs);
+    XFree(configs);
+
+    return context;
+}
+
+Context::Context(bool share) : _glx(false) {
+    const EGLint attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    EGLContext shareContext = EGL_NO_CONTEXT;
+    if (share) {
+        eglBindAPI(EGL_OPENGL_API);
+        shareContext = eglGetCurrentContext();
+
+        if (shareContext == EGL_NO_CONTEXT) {
+            ASSERT(glXGetCurrentContext() != NULL, "Shared contexts need a current context\n");
+
+            _glx = true;
+            _display = glXGetCurrentDisplay();
+            _context = createGlxContext((Display *)_display, glXGetCurrentContext());
+            ASSERT(_context != NULL, "Unable to create worker context\n");
+            return;
+        }
+
+        _display = eglGetCurrentDisplay();
+        _context = eglCreateContext((EGLDisplay)_display, EGL_NO_CONFIG_KHR, shareContext, attribs);
+        ASSERT(_context != EGL_NO_CONTEXT, "Unable to create worker context\n");
+        return;
+    }
+
+    /* Surfaceless contexts work with and without a display server, which lets
+     * several software (llvmpipe) contexts run side by side on one machine */
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (!eglInitialize(display, NULL, NULL) || !eglBindAPI(EGL_OPENGL_API))
+        FAIL("Unable to initialize EGL\n");
+
+    _display = display;
+    _context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+    ASSERT(_context != EGL_NO_CONTEXT, "Unable to create worker context\n");
+}
+
+Context::~Context() {
+    if (_glx)
+        glXDestroyContext((Display *)_display, (GLXContext)_context);
+    else
+        eglDestroyContext((EGLDisplay)_display, (EGLContext)_context);
+}
+
+void Context::makeCurrent() {
+    if (_glx)
+        glXMakeContextCurrent((Display *)_display, None, None, (GLXContext)_context);
+    else
+        eglMakeCurrent((EGLDisplay)_display, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext)_context);
+}
+
+void Context::release() {
+    if (_glx)
+        glXMakeContextCurrent((Display *)_display, None, None, NULL);
+    else
+        eglMakeCurrent((EGLDisplay)_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+#endif
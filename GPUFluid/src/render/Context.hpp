@@ -0,0 +1,46 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#ifndef RENDER_CONTEXT_HPP_
+#define RENDER_CONTEXT_HPP_
+
+/* Offscreen GL 4.5 core context for worker threads. Created on the thread
+ * that owns the main context, then made current on the worker. A shared
+ * context sees the textures, buffers and sync objects of the context that
+ * was current when it was created; framebuffers and vertex arrays are never
+ * shared. */
+class Context {
+    void *_display;
+    void *_context;
+    bool _glx;
+
+public:
+    Context(bool share = false);
+    ~Context();
+
+    void makeCurrent();
+    void release();
+};
+
+#endif /* RENDER_CONTEXT_HPP_ */
@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef RENDER_FRAMEBUFFERCACHE_HPP_
+#define RENDER_FRAMEBUFFERCACHE_HPP_
+
+#include <map>
+
+class RenderTarget;
+class Texture;
+
+/* Hands out one framebuffer per distinct set of color attachments. Each is
+ * configured and validated once on first use; after that a pass only pays
+ * for the framebuffer bind. */
+class FramebufferCache {
+    static const int MaxAttachments = 4;
+
+    struct Key {
+        const Texture *textures[MaxAttachments];
+        int width, height;
+
+        bool operator<(const Key &b) const;
+    };
+
+    std::map<Key, RenderTarget *> _targets;
+    RenderTarget *_bound;
+
+    void bind(const Key &key, int count);
+
+public:
+    FramebufferCache();
+    ~FramebufferCache();
+
+    void bind(const Texture &a);
+    void bind(const Texture &a, const Texture &b);
+    void bind(const Texture &a, const Texture &b, const Texture &c);
+    void bind(const Texture &a, const Texture &b, const Texture &c, const Texture &d);
+    void bindEmpty(int width, int height);
+
+    void unbind();
+};
+
+#endif /* RENDER_FRAMEBUFFERCACHE_HPP_ */
@@ -22,6 +22,7 @@ freely, subject to the following restrictions:
 */
 
 #include <GL/glew.h>
+#include <string.h>
 #include <stdio.h>
 
 #include "Shader.hpp"
@@ -130,6 +131,9 @@ void Shader::link() {
     glLinkProgram(_program);
 
     check();
+
+    /* Locations and values belong to the program that was just replaced */
+    _uniformCount = 0;
 }
 
 void Shader::bind() {
@@ -148,8 +152,12 @@ int Shader::uniformIndex(const char *name) {
             return i;
     }
 
+    ASSERT(_uniformCount < MAX_UNIFORMS, "Too many uniforms, cannot add %s\n", name);
+
     _uniformHash[_uniformCount] = hash;
     _uniformLocation[_uniformCount] = glGetUniformLocation(_program, name);
+    /* Uniforms are zero after linking, so the cache starts out in sync */
+    memset(&_uniformVals[_uniformCount], 0, sizeof(UniformValue));
     _uniformCount++;
 
     return _uniformCount - 1;
@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include <GL/glew.h>
+
+#include "StreamBuffer.hpp"
+#include "Debug.hpp"
+
+StreamBuffer::StreamBuffer(BufferType type, GLsizeiptr regionSize, int regionCount) :
+        _buffer(type), _regionCount(regionCount), _regionSize(regionSize), _region(0), _head(0) {
+    ASSERT(regionCount <= MaxRegions, "Too many stream buffer regions: %d\n", regionCount);
+
+    _alignment = 4;
+    if (type == UNIFORM_BUFFER)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &_alignment);
+    else if (type == SHADER_STORAGE_BUFFER)
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &_alignment);
+
+    _regionSize = (_regionSize + _alignment - 1)/_alignment*_alignment;
+
+    for (int i = 0; i < MaxRegions; i++)
+        _fences[i] = 0;
+
+    int flags = MAP_WRITE | MAP_PERSISTENT | MAP_COHERENT;
+
+    _buffer.initStorage(_regionSize*_regionCount, flags);
+    _buffer.bind();
+    _buffer.mapRange(0, _regionSize*_regionCount, flags);
+    _buffer.unbind();
+
+    _base = (unsigned char *)_buffer.data();
+}
+
+StreamBuffer::~StreamBuffer() {
+    for (int i = 0; i < _regionCount; i++)
+        if (_fences[i])
+            glDeleteSync(_fences[i]);
+
+    _buffer.bind();
+    _buffer.unmap();
+    _buffer.unbind();
+}
+
+void *StreamBuffer::allocate(GLsizeiptr size, GLintptr &offset) {
+    GLintptr start = (_head + _alignment - 1)/_alignment*_alignment;
+    ASSERT(start + size <= _regionSize, "Stream buffer region overflow (%d of %d bytes)\n",
+        (int)(start + size), (int)_regionSize);
+
+    _head = start + size;
+    offset = _region*_regionSize + start;
+
+    return _base + offset;
+}
+
+void StreamBuffer::advance() {
+    _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    _region = (_region + 1) % _regionCount;
+    _head = 0;
+
+    if (_fences[_region]) {
+        while (glClientWaitSync(_fences[_region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(_fences[_region]);
+        _fences[_region] = 0;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef RENDER_STREAMBUFFER_HPP_
+#define RENDER_STREAMBUFFER_HPP_
+
+#include <GL/glew.h>
+
+#include "BufferObject.hpp"
+
+/* Ring of persistently mapped regions. The CPU writes into the current
+ * region while the GPU may still be reading older ones; advance() fences
+ * the region just filled and only blocks if the one it moves into has not
+ * been consumed yet. */
+class StreamBuffer {
+    static const int MaxRegions = 4;
+
+    BufferObject _buffer;
+    unsigned char *_base;
+
+    GLsync _fences[MaxRegions];
+    int _regionCount;
+    GLsizeiptr _regionSize;
+    GLint _alignment;
+
+    int _region;
+    GLintptr _head;
+
+public:
+    StreamBuffer(BufferType type, GLsizeiptr regionSize, int regionCount = 3);
+    ~StreamBuffer();
+
+    void *allocate(GLsizeiptr size, GLintptr &offset);
+    void advance();
+
+    BufferObject &buffer() {
+        return _buffer;
+    }
+};
+
+#endif /* RENDER_STREAMBUFFER_HPP_ */
@@ -83,6 +83,8 @@ unsigned long long int Texture::_memoryUsage = 0;
 int Texture::_selectedUnit = 0;
 int Texture::_nextTicket = 1;
 int Texture::_unitTicket[MaxTextureUnits] = {0};
+int Texture::_clockHand = 0;
+bool Texture::_unitReferenced[MaxTextureUnits] = {false};
 Texture *Texture::_units[MaxTextureUnits] = {0};
 
 Texture::Texture(TextureType type, int width, int height, int depth, int levels) :
@@ -102,6 +104,9 @@ Texture::Texture(TextureType type, int width, int height, int depth, int levels)
 }
 
 Texture::~Texture() {
+    if (_boundUnit != -1)
+        _units[_boundUnit] = 0;
+
     if (_glName) {
         _memoryUsage -= size();
         glDeleteTextures(1, &_glName);
@@ -109,17 +114,37 @@ Texture::~Texture() {
 }
 
 void Texture::selectUnit(int unit) {
+#if !USE_DSA
     if (unit != _selectedUnit) {
         glActiveTexture(GL_TEXTURE0 + unit);
         _selectedUnit = unit;
     }
+#endif
 }
 
 void Texture::markAsUsed(int unit) {
+#if USE_DSA
+    _unitReferenced[unit] = true;
+#else
     _unitTicket[unit] = _nextTicket++;
+#endif
 }
 
 int Texture::selectVictimUnit() {
+#if USE_DSA
+    /* Second chance clock: units referenced since the hand last passed are
+     * skipped, so textures keep their unit for as long as they are in use and
+     * steady-state frames find every texture already bound */
+    while (_unitReferenced[_clockHand]) {
+        _unitReferenced[_clockHand] = false;
+        _clockHand = (_clockHand + 1) % MaxTextureUnits;
+    }
+
+    int unit = _clockHand;
+    _clockHand = (_clockHand + 1) % MaxTextureUnits;
+
+    return unit;
+#else
     int leastTicket = _unitTicket[0];
     int leastUnit = 0;
 
@@ -131,6 +156,7 @@ int Texture::selectVictimUnit() {
     }
 
     return leastUnit;
+#endif
 }
 
 void Texture::setFormat(TexelType texel, int channels, int chan_bytes) {
@@ -153,6 +179,25 @@ void Texture::setFilter(bool clamp, bool linear) {
     GLenum coord_mode = (clamp ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
     GLenum inter_mode = (linear ? GL_LINEAR : GL_NEAREST);
 
+#if USE_DSA
+    if (_type > TEXTURE_BUFFER) {
+        glTextureParameteri(_glName, GL_TEXTURE_WRAP_S, coord_mode);
+    }
+
+    if (_type > TEXTURE_1D) {
+        glTextureParameteri(_glName, GL_TEXTURE_WRAP_T, coord_mode);
+    }
+
+    if (_type > TEXTURE_2D || _type == TEXTURE_CUBE) {
+        glTextureParameteri(_glName, GL_TEXTURE_WRAP_R, coord_mode);
+    }
+
+    if (_type != TEXTURE_BUFFER) {
+        glTextureParameteri(_glName, GL_TEXTURE_MIN_FILTER, inter_mode);
+        glTextureParameteri(_glName, GL_TEXTURE_MAG_FILTER, inter_mode);
+        glTextureParameteri(_glName, GL_TEXTURE_MAX_LEVEL, _levels - 1);
+    }
+#else
     bindAny();
 
     if (_type > TEXTURE_BUFFER) {
@@ -172,9 +217,29 @@ void Texture::setFilter(bool clamp, bool linear) {
         glTexParameteri(_glType, GL_TEXTURE_MAG_FILTER, inter_mode);
         glTexParameteri(_glType, GL_TEXTURE_MAX_LEVEL, _levels - 1);
     }
+#endif
 }
 
 void Texture::init(GLuint bufferObject) {
+#if USE_DSA
+    glCreateTextures(_glType, 1, &_glName);
+
+    switch (_type) {
+    case TEXTURE_BUFFER:
+        glTextureBuffer(_glName, _glFormat, bufferObject);
+        break;
+    case TEXTURE_1D:
+        glTextureStorage1D(_glName, _levels, _glFormat, _width);
+        break;
+    case TEXTURE_CUBE:
+    case TEXTURE_2D:
+        glTextureStorage2D(_glName, _levels, _glFormat, _width, _height);
+        break;
+    case TEXTURE_3D:
+        glTextureStorage3D(_glName, _levels, _glFormat, _width, _height, _depth);
+        break;
+    }
+#else
     glGenTextures(1, &_glName);
 
     bindAny();
@@ -196,6 +261,7 @@ void Texture::init(GLuint bufferObject) {
         glTexStorage3D(GL_TEXTURE_3D, _levels, _glFormat, _width, _height, _depth);
         break;
     }
+#endif
 
     _memoryUsage += size();
 
@@ -203,12 +269,31 @@ void Texture::init(GLuint bufferObject) {
 }
 
 void Texture::copy(void *data, int level) {
-    bindAny();
-
     int w = std::max(_width  >> level, 1);
     int h = std::max(_height >> level, 1);
     int d = std::max(_depth  >> level, 1);
 
+#if USE_DSA
+    switch (_type) {
+    case TEXTURE_BUFFER:
+        FAIL("Texture copy not available for texture buffer - use BufferObject::copyData instead");
+        break;
+    case TEXTURE_1D:
+        glTextureSubImage1D(_glName, level, 0, w, _glChanType, _elementType, data);
+        break;
+    case TEXTURE_CUBE:
+        glTextureSubImage3D(_glName, level, 0, 0, 0, w, h, 6, _glChanType, _elementType, data);
+        break;
+    case TEXTURE_2D:
+        glTextureSubImage2D(_glName, level, 0, 0, w, h, _glChanType, _elementType, data);
+        break;
+    case TEXTURE_3D:
+        glTextureSubImage3D(_glName, level, 0, 0, 0, w, h, d, _glChanType, _elementType, data);
+        break;
+    }
+#else
+    bindAny();
+
     switch (_type) {
     case TEXTURE_BUFFER:
         FAIL("Texture copy not available for texture buffer - use BufferObject::copyData instead");
@@ -234,6 +319,7 @@ void Texture::copy(void *data, int level) {
                 _glChanType, _elementType, data);
         break;
     }
+#endif
 }
 
 void Texture::copyPbo(BufferObject &pbo, int level) {
@@ -250,6 +336,35 @@ void Texture::copyPbo(BufferObject &pbo, int level) {
     pbo.unbind();
 }
 
+void Texture::clear(int level) {
+    ASSERT(_type != TEXTURE_BUFFER, "Texture clear not available for texture buffer\n");
+
+    glClearTexImage(_glName, level, _glChanType, _elementType, NULL);
+}
+
+void Texture::read(void *data, int level) {
+    read(data, _glChanType, _elementType, level);
+}
+
+void Texture::read(void *data, GLenum format, GLenum type, int level) {
+    ASSERT(_type != TEXTURE_BUFFER, "Texture read not available for texture buffer\n");
+
+#if USE_DSA
+    glGetTextureImage(_glName, level, format, type, (GLsizei)size(), data);
+#else
+    bindAny();
+
+    if (_type == TEXTURE_CUBE) {
+        int w = std::max(_width  >> level, 1);
+        int h = std::max(_height >> level, 1);
+
+        for (int i = 0; i < 6; i++)
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, format, type, (uint8_t *)data + i*w*h*_elementSize);
+    } else
+        glGetTexImage(_glType, level, format, type, data);
+#endif
+}
+
 void Texture::bindImage(int unit, bool read, bool write, int level) {
     GLenum mode = read ? (write ? GL_READ_WRITE : GL_READ_ONLY) : GL_WRITE_ONLY;
 
@@ -257,6 +372,21 @@ void Texture::bindImage(int unit, bool read, bool write, int level) {
 }
 
 void Texture::bind(int unit) {
+#if USE_DSA
+    markAsUsed(unit);
+
+    if (_units[unit] == this)
+        return;
+
+    if (_units[unit])
+        _units[unit]->_boundUnit = -1;
+    if (_boundUnit != -1)
+        _units[_boundUnit] = 0;
+
+    _units[unit] = this;
+    glBindTextureUnit(unit, _glName);
+    _boundUnit = unit;
+#else
     if (_units[unit])
         _units[unit]->_boundUnit = -1;
 
@@ -269,6 +399,7 @@ void Texture::bind(int unit) {
     _units[unit] = this;
     glBindTexture(_glType, _glName);
     _boundUnit = unit;
+#endif
 }
 
 void Texture::bindAny() {
@@ -26,6 +26,12 @@ freely, subject to the following restrictions:
 
 #include <GL/gl.h>
 
+/* Selects the GL 4.5 direct state access backend. Set to 0 on drivers
+ * without ARB_direct_state_access to fall back to bind-to-edit */
+#ifndef USE_DSA
+#define USE_DSA 1
+#endif
+
 class BufferObject;
 
 enum TexelType {
@@ -50,6 +56,8 @@ class Texture {
     static int _selectedUnit;
     static int _nextTicket;
     static int _unitTicket[MaxTextureUnits];
+    static int _clockHand;
+    static bool _unitReferenced[MaxTextureUnits];
     static Texture *_units[MaxTextureUnits];
     static unsigned long long int _memoryUsage;
 
@@ -86,6 +94,9 @@ public:
 
     void copy(void *data, int level = 0);
     void copyPbo(BufferObject& pbo, int level = 0);
+    void clear(int level = 0);
+    void read(void *data, int level = 0);
+    void read(void *data, GLenum format, GLenum type, int level = 0);
 
     void bindImage(int unit, bool read = true, bool write = true, int level = 0);
     void bind(int unit);
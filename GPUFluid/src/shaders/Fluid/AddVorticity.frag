@@ -2,7 +2,6 @@ uniform sampler2D WU;
 uniform sampler2D WV;
 uniform sampler2D U;
 uniform sampler2D V;
-uniform float Timestep;
 
 in vec2 vCoord;
 
@@ -1,10 +1,9 @@
 uniform sampler2D D;
 uniform sampler2D U;
 uniform sampler2D V;
-uniform float Timestep;
 uniform vec2 Offset;
-uniform float InvHx;
 uniform ivec2 Limits;
+uniform float Direction;
 
 in vec2 vCoord;
 
@@ -17,13 +16,14 @@ vec2 velocity(vec2 pos) {
 }
 
 vec2 rungeKutta3(vec2 pos) {
+    float dt = Direction*Timestep;
     vec2 first = velocity(pos);
-    vec2 midPos = pos - 0.5*Timestep*first;
+    vec2 midPos = pos - 0.5*dt*first;
     vec2 mid = velocity(midPos);
-    vec2 lastPos = pos - 0.75*Timestep*mid;
+    vec2 lastPos = pos - 0.75*dt*mid;
     vec2 last = velocity(lastPos);
     
-    return -Timestep*((2.0/9.0)*first + (3.0/9.0)*mid + (4.0/9.0)*last);
+    return -dt*((2.0/9.0)*first + (3.0/9.0)*mid + (4.0/9.0)*last);
 }
 
 float cerp(float x, float a, float b, float c, float d) {
@@ -159,6 +159,10 @@ float textureCerp(vec2 pos) {
 void main() {
     ivec2 coord = ivec2(vCoord);
     vec2 fCoord = vec2(coord) + 0.5;
+    vec2 pos = fCoord + rungeKutta3(fCoord + Offset);
+    
+    if (solidCell(clamp(ivec2(pos), ivec2(0), Limits)))
+        pos = fCoord;
 
-    FragColor0 = textureCerp(fCoord + rungeKutta3(fCoord + Offset));
+    FragColor0 = textureCerp(pos);
 }
\ No newline at end of file
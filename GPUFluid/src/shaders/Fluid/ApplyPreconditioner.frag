@@ -8,16 +8,23 @@ out float FragColor1;
 void main() {
     ivec2 coord = ivec2(vCoord);
     
+    if (solidCell(coord)) {
+        FragColor0 = FragColor1 = 0.0;
+        return;
+    }
+    
     float C = texelFetch(R, coord, 0).r;
     
     float A  = 9.0/8.0*C;
-    float A2 = 1.0/4.0*texelFetchOffset(R, coord, 0, ivec2( 1,  0)).r;
-    float A4 = 1.0/4.0*texelFetchOffset(R, coord, 0, ivec2( 0,  1)).r;
-    float A1 = 0.0, A3 = 0.0;
-    if (coord.x > 0)
+    float A1 = 0.0, A2 = 0.0, A3 = 0.0, A4 = 0.0;
+    if (coord.x > 0 && !solidCell(coord + ivec2(-1, 0)))
         A1 = 1.0/4.0*texelFetchOffset(R, coord, 0, ivec2(-1,  0)).r;
-    if (coord.y > 0)
+    if (!solidCell(coord + ivec2(1, 0)))
+        A2 = 1.0/4.0*texelFetchOffset(R, coord, 0, ivec2( 1,  0)).r;
+    if (coord.y > 0 && !solidCell(coord + ivec2(0, -1)))
         A3 = 1.0/4.0*texelFetchOffset(R, coord, 0, ivec2( 0, -1)).r;
+    if (!solidCell(coord + ivec2(0, 1)))
+        A4 = 1.0/4.0*texelFetchOffset(R, coord, 0, ivec2( 0,  1)).r;
     
     A += A1 + A2 + A3 + A4;
     
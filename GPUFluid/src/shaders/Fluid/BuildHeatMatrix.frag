@@ -1,4 +1,4 @@
-uniform float Scale;
+uniform sampler2D Active;
 
 in vec2 vCoord;
 
@@ -6,23 +6,30 @@ out float FragColor0;
 out float FragColor1;
 out float FragColor2;
 
+/* Inactive tiles sit at ambient temperature; treat their border as insulating */
+bool heatCell(ivec2 coord) {
+    return fluidCell(coord) && texelFetch(Active, coord/TILE_SIZE, 0).r != 0.0;
+}
+
 void main() {
     ivec2 coord = ivec2(vCoord);
     
     float D = 1.0, PX = 0.0, PY = 0.0;
 
-    if (fluidCell(coord + ivec2(1, 0))) {
-        PX = -Scale;
-        D += Scale;
-    }
-    if (fluidCell(coord + ivec2(0, 1))) {
-        PY = -Scale;
-        D += Scale;
+    if (fluidCell(coord)) {
+        if (heatCell(coord + ivec2(1, 0))) {
+            PX = -HeatScale;
+            D += HeatScale;
+        }
+        if (heatCell(coord + ivec2(0, 1))) {
+            PY = -HeatScale;
+            D += HeatScale;
+        }
+        if (heatCell(coord + ivec2(0, -1)))
+            D += HeatScale;
+        if (heatCell(coord + ivec2(-1, 0)))
+            D += HeatScale;
     }
-    if (fluidCell(coord + ivec2(0, -1)))
-        D += Scale;
-    if (fluidCell(coord + ivec2(-1, 0)))
-        D += Scale;
     
     FragColor0 = D;
     FragColor1 = PX;
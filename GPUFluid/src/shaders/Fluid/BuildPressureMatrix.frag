@@ -1,4 +1,3 @@
-uniform float Scale;
 
 in vec2 vCoord;
 
@@ -11,18 +10,20 @@ void main() {
     
     float D = 0.0, PX = 0.0, PY = 0.0;
 
-    if (fluidCell(coord + ivec2(1, 0))) {
-        PX = -Scale;
-        D += Scale;
+    if (fluidCell(coord)) {
+        if (fluidCell(coord + ivec2(1, 0))) {
+            PX = -PressureScale;
+            D += PressureScale;
+        }
+        if (fluidCell(coord + ivec2(0, 1))) {
+            PY = -PressureScale;
+            D += PressureScale;
+        }
+        if (fluidCell(coord + ivec2(0, -1)))
+            D += PressureScale;
+        if (fluidCell(coord + ivec2(-1, 0)))
+            D += PressureScale;
     }
-    if (fluidCell(coord + ivec2(0, 1))) {
-        PY = -Scale;
-        D += Scale;
-    }
-    if (fluidCell(coord + ivec2(0, -1)))
-        D += Scale;
-    if (fluidCell(coord + ivec2(-1, 0)))
-        D += Scale;
     
     FragColor0 = D;
     FragColor1 = PX;
@@ -1,6 +1,5 @@
 uniform sampler2D U;
 uniform sampler2D V;
-uniform float InvHx;
 
 in vec2 vCoord;
 
@@ -8,8 +7,13 @@ out float FragColor0;
 
 void main() {
     ivec2 coord = ivec2(vCoord);
+    
+    if (!fluidCell(coord)) {
+        FragColor0 = 0.0;
+        return;
+    }
 
     float divU = texelFetchOffset(U, coord, 0, ivec2(1, 0)).r - texelFetch(U, coord, 0).r;
     float divV = texelFetchOffset(V, coord, 0, ivec2(0, 1)).r - texelFetch(V, coord, 0).r;
-    FragColor0 = -InvHx*(divU + divV);
+    FragColor0 = -(divU + divV);
 }
\ No newline at end of file
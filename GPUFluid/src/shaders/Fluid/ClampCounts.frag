@@ -1,11 +1,17 @@
 uniform usampler2D Counts;
+uniform usampler2D Starts;
+uniform usampler2D Ends;
+uniform ivec2 Range;
+uniform bool Sorted;
 
 layout(pixel_center_integer) in vec4 gl_FragCoord;
 
 out uint FragColor0;
 
 void main() {
-    uint res = clamp(texelFetch(Counts, ivec2(gl_FragCoord.xy), 0).r, 3u, 8u);
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    uint count = Sorted ? texelFetch(Ends, coord, 0).r - texelFetch(Starts, coord, 0).r : texelFetch(Counts, coord, 0).r;
+    uint res = solidCell(coord) ? 0u : clamp(count, uint(Range.x), uint(Range.y));
     
     FragColor0 = (res << 28u) | 0x8000000u | res; 
 }
\ No newline at end of file
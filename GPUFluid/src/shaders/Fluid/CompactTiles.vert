@@ -0,0 +1,35 @@
+uniform sampler2D Raw;
+uniform sampler2D Fluid;
+uniform sampler2D Previous;
+
+layout(rg16ui) uniform writeonly uimageBuffer Active;
+layout(rg16ui) uniform writeonly uimageBuffer Inactive;
+layout(rg16ui) uniform writeonly uimageBuffer Retired;
+layout(r32ui) uniform uimageBuffer Commands;
+layout(r8) uniform writeonly image2D Current;
+
+uniform ivec2 TileCount;
+
+void main() {
+    ivec2 tile = ivec2(gl_VertexID % TileCount.x, gl_VertexID/TileCount.x);
+    
+    bool used = false;
+    if (texelFetch(Fluid, tile, 0).r != 0.0)
+        for (int y = -1; y <= 1; y++)
+            for (int x = -1; x <= 1; x++)
+                if (texelFetch(Raw, clamp(tile + ivec2(x, y), ivec2(0), TileCount - 1), 0).r != 0.0)
+                    used = true;
+    
+    uvec4 entry = uvec4(tile, 0u, 0u);
+    if (used)
+        imageStore(Active, int(imageAtomicAdd(Commands, 1, 1u)), entry);
+    else {
+        imageStore(Inactive, int(imageAtomicAdd(Commands, 5, 1u)), entry);
+        if (texelFetch(Previous, tile, 0).r != 0.0)
+            imageStore(Retired, int(imageAtomicAdd(Commands, 9, 1u)), entry);
+    }
+    
+    imageStore(Current, tile, vec4(used ? 1.0 : 0.0));
+    
+    gl_Position = vec4(10000.0, 10000.0, 10000.0, 1.0);
+}
\ No newline at end of file
@@ -1,5 +1,4 @@
 uniform sampler2D W;
-uniform float Scale;
 uniform float Hx;
 uniform float Epsilon;
 
@@ -19,7 +18,7 @@ void main() {
         float V0 = texelFetchOffset(W, coord, 0, ivec2( 0, -1)).r;
         float V1 = texelFetchOffset(W, coord, 0, ivec2( 0,  1)).r;
         
-        vec3 N = vec3(abs(U1) - abs(U0), abs(V1) - abs(V0), 0.0)*Scale;
+        vec3 N = vec3(abs(U1) - abs(U0), abs(V1) - abs(V0), 0.0)*CurlScale;
         N = N/(length(N) + 1e-10);
         vec3 W = vec3(0.0, 0.0, W0);
         M = Epsilon*Hx*(cross(N, W).xy);
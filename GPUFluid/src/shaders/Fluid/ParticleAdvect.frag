@@ -1,9 +1,6 @@
 uniform sampler2D PPos;
 uniform sampler2D U;
 uniform sampler2D V;
-uniform ivec2 PointInfo;
-uniform float InvHx;
-uniform float Timestep;
 
 layout(pixel_center_integer) in vec4 gl_FragCoord;
 
@@ -32,7 +29,10 @@ void main() {
         discard;
     
     vec2 pos = texelFetch(PPos, coord, 0).xy;
-    pos += rungeKutta3(pos);
+    vec2 newPos = clamp(pos + rungeKutta3(pos), vec2(0.0), vec2(WIDTH - 1.0001, HEIGHT - 1.0001));
     
-    FragColor0 = clamp(pos, vec2(0.0), vec2(WIDTH - 1.0001, HEIGHT - 1.0001));
+    if (solidCell(ivec2(newPos)))
+        newPos = pos;
+    
+    FragColor0 = newPos;
 }
\ No newline at end of file
@@ -1,17 +1,20 @@
 layout(r32ui) uniform uimage2D Counts;
 layout(rg32f) uniform image2D ResultP;
 layout(rgba32f) uniform image2D ResultQ;
+layout(rgba32f) uniform image2D ResultG;
 
 uniform usampler2D Offsets;
 uniform sampler2D PPos;
 uniform sampler2D Q;
+uniform sampler2D G;
+uniform bool Affine;
 
-uniform ivec2 PointInfo;
 
 void main() {
     ivec2 coord = ivec2(gl_VertexID % PointInfo.x, gl_VertexID/PointInfo.x);
     vec2 pos = texelFetch(PPos, coord, 0).xy;
     vec4 qs  = texelFetch(Q, coord, 0);
+    ivec2 src = coord;
     
     ivec2 iPos = ivec2(pos - 0.0);
     
@@ -25,6 +28,9 @@ void main() {
     
     imageStore(ResultP, coord, pos.xyxy);
     imageStore(ResultQ, coord, qs);
+    if (Affine) {
+        imageStore(ResultG, coord, texelFetch(G, src, 0));
+    }
     
     gl_Position = vec4(10000.0, 10000.0, 10000.0, 1.0);
 }
\ No newline at end of file
@@ -1,7 +1,6 @@
 layout(r32ui) uniform uimage2D Counts;
 uniform sampler2D PPos;
 
-uniform ivec2 PointInfo;
 
 void main() {
     ivec2 coord = ivec2(gl_VertexID % PointInfo.x, gl_VertexID/PointInfo.x);
@@ -1,6 +1,5 @@
 uniform sampler2D PPos;
 uniform sampler2D Q;
-uniform ivec2 PointInfo;
 uniform vec2 Scale;
 uniform vec2 Offset;
 
@@ -1,5 +1,7 @@
 uniform vec4 QuadInfo;
 uniform vec4 TexelInfo;
+uniform int Tiled;
+uniform usamplerBuffer Tiles;
 uniform sampler2D Alpha;
 uniform sampler2D Beta;
 
@@ -15,22 +17,32 @@ void main() {
     else
         vAlpha = A/B;
     
+    vec4 quad = QuadInfo, texel = TexelInfo;
+    if (Tiled != 0) {
+        vec2 tile = vec2(texelFetch(Tiles, gl_InstanceID).xy*uint(TILE_SIZE));
+        texel.xy = max(TexelInfo.xy, tile);
+        texel.zw = max(min(TexelInfo.zw, tile + float(TILE_SIZE)), texel.xy);
+        
+        vec2 scale = (QuadInfo.zw - QuadInfo.xy)/(TexelInfo.zw - TexelInfo.xy);
+        quad = QuadInfo.xyxy + (texel - TexelInfo.xyxy)*scale.xyxy;
+    }
+    
     switch(gl_VertexID) {
     case 0:
-        vCoord = TexelInfo.xy;
-        gl_Position = vec4(QuadInfo.xy, 0.0, 1.0);
+        vCoord = texel.xy;
+        gl_Position = vec4(quad.xy, 0.0, 1.0);
         break;
     case 1:
-        vCoord = TexelInfo.xw;
-        gl_Position = vec4(QuadInfo.xw, 0.0, 1.0);
+        vCoord = texel.xw;
+        gl_Position = vec4(quad.xw, 0.0, 1.0);
         break;
     case 2:
-        vCoord = TexelInfo.zw;
-        gl_Position = vec4(QuadInfo.zw, 0.0, 1.0);
+        vCoord = texel.zw;
+        gl_Position = vec4(quad.zw, 0.0, 1.0);
         break;
     case 3:
-        vCoord = TexelInfo.zy;
-        gl_Position = vec4(QuadInfo.zy, 0.0, 1.0);
+        vCoord = texel.zy;
+        gl_Position = vec4(quad.zy, 0.0, 1.0);
         break;
     }
 }
\ No newline at end of file
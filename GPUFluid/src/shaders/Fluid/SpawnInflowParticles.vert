@@ -1,10 +1,11 @@
 layout(rg32f) uniform image2D ResultP;
 layout(rgba32f) uniform image2D ResultQ;
+layout(rgba32f) uniform image2D ResultG;
 
-uniform ivec2 PointInfo;
 uniform vec4 QuadInfo;
 uniform vec4 QMin;
 uniform vec4 QValue;
+uniform bool Affine;
 
 vec2 rand(uvec2 p) {
     const uint M = 1664525u, C = 1013904223u;
@@ -28,6 +29,8 @@ void main() {
     
     imageStore(ResultP, coord, pos.xyxy);
     imageStore(ResultQ, coord, qs);
+    if (Affine)
+        imageStore(ResultG, coord, vec4(0.0));
     
     gl_Position = vec4(10000.0, 10000.0, 10000.0, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,302 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include <algorithm>
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "FieldCache.hpp"
+#include "render/Texture.hpp"
+#include "lodepng/lodepng.h"
+#include "Debug.hpp"
+
+using namespace std;
+
+FieldCache::FieldCache(const char *path, int tileSize, int threads) :
+        _fileSize(sizeof(CacheHeader)), _threadCount(threads), _current(NULL),
+        _writing(false), _quit(false) {
+    _fp = fopen(path, "wb");
+    ASSERT(_fp != NULL, "Unable to open field cache %s\n", path);
+
+    memset(&_header, 0, sizeof(CacheHeader));
+    memcpy(_header.magic, CacheMagic, sizeof(CacheMagic));
+    _header.version  = CacheVersion;
+    _header.tileSize = tileSize;
+    fwrite(&_header, sizeof(CacheHeader), 1, _fp);
+
+    _threads = new thread[_threadCount];
+    for (int i = 0; i < _threadCount; i++)
+        _threads[i] = thread(&FieldCache::run, this);
+}
+
+FieldCache::~FieldCache() {
+    flush();
+
+    {
+        unique_lock<mutex> lock(_mutex);
+        _quit = true;
+    }
+    _jobAdded.notify_all();
+
+    for (int i = 0; i < _threadCount; i++)
+        _threads[i].join();
+    delete[] _threads;
+
+    _header.indexOffset = _fileSize;
+    _header.frameCount  = _index.size();
+    if (!_index.empty())
+        fwrite(&_index[0], sizeof(CacheIndexEntry), _index.size(), _fp);
+
+    fseek(_fp, 0, SEEK_SET);
+    fwrite(&_header, sizeof(CacheHeader), 1, _fp);
+    fclose(_fp);
+}
+
+void FieldCache::run() {
+    for (;;) {
+        Field *field;
+        {
+            unique_lock<mutex> lock(_mutex);
+            while (!_quit && _jobs.empty())
+                _jobAdded.wait(lock);
+            if (_jobs.empty())
+                break;
+            field = _jobs.front();
+            _jobs.pop_front();
+        }
+
+        encode(*field);
+
+        {
+            unique_lock<mutex> lock(_mutex);
+            field->frame->remaining--;
+            releaseFrames(lock);
+        }
+    }
+}
+
+void FieldCache::encode(Field &field) {
+    CacheField &h = field.header;
+    int tileSize = _header.tileSize;
+    int bytes = h.encoding == CACHE_FLOAT16 ? 2 : 4;
+
+    unsigned char *raw    = new unsigned char[tileSize*tileSize*4];
+    unsigned char *planes = new unsigned char[tileSize*tileSize*4];
+
+    LodePNGCompressSettings settings;
+    lodepng_compress_settings_init(&settings);
+    /* Planes are at most a few kB, a long window only costs time */
+    settings.windowsize = 256;
+
+    field.tiles.resize(h.tilesX*h.tilesY);
+    for (uint32_t ty = 0; ty < h.tilesY; ty++) {
+        for (uint32_t tx = 0; tx < h.tilesX; tx++) {
+            CacheTile &tile = field.tiles[tx + ty*h.tilesX];
+            int x0 = tx*tileSize;
+            int y0 = ty*tileSize;
+            int w = min(tileSize, (int)h.width  - x0);
+            int t = min(tileSize, (int)h.height - y0);
+            int count = w*t;
+
+            for (int y = 0, i = 0; y < t; y++) {
+                for (int x = 0; x < w; x++, i++) {
+                    float value = field.values[(x0 + x) + (y0 + y)*h.width];
+                    if (bytes == 2) {
+                        uint16_t half = floatToHalf(value);
+                        memcpy(raw + i*2, &half, 2);
+                    } else
+                        memcpy(raw + i*4, &value, 4);
+                }
+            }
+
+            bool constant = true;
+            for (int i = 1; i < count && constant; i++)
+                constant = memcmp(raw, raw + i*bytes, bytes) == 0;
+
+            if (constant) {
+                uint32_t bits = 0;
+                memcpy(&bits, raw, bytes);
+                tile.offset = bits;
+                tile.size   = 0;
+                tile.flags  = TILE_CONSTANT;
+                continue;
+            }
+
+            for (int i = 0; i < count; i++)
+                for (int b = 0; b < bytes; b++)
+                    planes[b*count + i] = raw[i*bytes + b];
+
+            unsigned char *packed = NULL;
+            size_t packedSize = 0;
+            size_t rawSize = count*bytes;
+
+            tile.offset = field.data.size();
+            if (field.compress && !lodepng_zlib_compress(&packed, &packedSize, planes, rawSize, &settings) &&
+                    packedSize < rawSize) {
+                field.data.insert(field.data.end(), packed, packed + packedSize);
+                tile.size  = packedSize;
+                tile.flags = TILE_COMPRESSED;
+            } else {
+                field.data.insert(field.data.end(), planes, planes + rawSize);
+                tile.size  = rawSize;
+                tile.flags = 0;
+            }
+            free(packed);
+        }
+    }
+
+    delete[] raw;
+    delete[] planes;
+    delete[] field.values;
+    field.values = NULL;
+}
+
+/* Frames must land in the file in order, so whichever worker finds the
+ * oldest frame complete writes it while the others keep encoding */
+void FieldCache::releaseFrames(unique_lock<mutex> &lock) {
+    while (!_writing && !_frames.empty() && _frames.front()->remaining == 0) {
+        Frame *frame = _frames.front();
+        _frames.pop_front();
+        _writing = true;
+
+        lock.unlock();
+        writeFrame(*frame);
+        for (size_t i = 0; i < frame->fields.size(); i++)
+            delete frame->fields[i];
+        delete frame;
+        lock.lock();
+
+        _writing = false;
+        _frameDone.notify_all();
+    }
+}
+
+void FieldCache::writeFrame(Frame &frame) {
+    static const unsigned char padding[8] = {0};
+
+    int fieldCount = frame.fields.size();
+
+    uint64_t offset = sizeof(CacheFrame) + fieldCount*sizeof(CacheField);
+    for (int i = 0; i < fieldCount; i++) {
+        frame.fields[i]->header.tileOffset = offset;
+        offset += frame.fields[i]->tiles.size()*sizeof(CacheTile);
+    }
+    for (int i = 0; i < fieldCount; i++) {
+        frame.fields[i]->header.dataOffset = offset;
+        offset += frame.fields[i]->data.size();
+    }
+    int pad = (8 - offset % 8) % 8;
+
+    frame.header.fieldCount = fieldCount;
+    frame.header.size = offset + pad;
+
+    fwrite(&frame.header, sizeof(CacheFrame), 1, _fp);
+    for (int i = 0; i < fieldCount; i++)
+        fwrite(&frame.fields[i]->header, sizeof(CacheField), 1, _fp);
+    for (int i = 0; i < fieldCount; i++)
+        fwrite(&frame.fields[i]->tiles[0], sizeof(CacheTile), frame.fields[i]->tiles.size(), _fp);
+    for (int i = 0; i < fieldCount; i++)
+        if (!frame.fields[i]->data.empty())
+            fwrite(&frame.fields[i]->data[0], 1, frame.fields[i]->data.size(), _fp);
+    fwrite(padding, 1, pad, _fp);
+
+    CacheIndexEntry entry;
+    entry.offset = _fileSize;
+    entry.frame  = frame.header.frame;
+    entry.time   = frame.header.time;
+    _index.push_back(entry);
+
+    _fileSize += frame.header.size;
+}
+
+void FieldCache::beginFrame(int frame, float time) {
+    ASSERT(_current == NULL, "Previous cache frame was not ended\n");
+
+    _current = new Frame();
+    memset(&_current->header, 0, sizeof(CacheFrame));
+    _current->header.magic = FrameMagic;
+    _current->header.frame = frame;
+    _current->header.time  = time;
+    _current->remaining = 0;
+}
+
+FieldCache::Field *FieldCache::newField(const char *name, int width, int height, CacheEncoding encoding, bool compress) {
+    ASSERT(_current != NULL, "Fields can only be added between beginFrame and endFrame\n");
+    ASSERT(strlen(name) < sizeof(CacheField().name), "Field name %s is too long\n", name);
+
+    Field *field = new Field();
+    memset(&field->header, 0, sizeof(CacheField));
+    strcpy(field->header.name, name);
+    field->header.width    = width;
+    field->header.height   = height;
+    field->header.tilesX   = (width  - 1)/_header.tileSize + 1;
+    field->header.tilesY   = (height - 1)/_header.tileSize + 1;
+    field->header.encoding = encoding;
+    field->frame    = _current;
+    field->values   = new float[width*height];
+    field->compress = compress;
+
+    _current->fields.push_back(field);
+    return field;
+}
+
+/* Only the first channel is cached */
+void FieldCache::addField(const char *name, Texture &src, CacheEncoding encoding, bool compress) {
+    Field *field = newField(name, src.width(), src.height(), encoding, compress);
+    src.read(field->values, GL_RED, GL_FLOAT);
+}
+
+void FieldCache::addField(const char *name, const float *values, int width, int height,
+        CacheEncoding encoding, bool compress) {
+    Field *field = newField(name, width, height, encoding, compress);
+    memcpy(field->values, values, width*height*sizeof(float));
+}
+
+void FieldCache::endFrame() {
+    ASSERT(_current != NULL, "No cache frame to end\n");
+
+    {
+        unique_lock<mutex> lock(_mutex);
+        /* Bounds the memory held by frames still waiting on the workers */
+        while (_frames.size() >= MaxPendingFrames)
+            _frameDone.wait(lock);
+
+        _current->remaining = _current->fields.size();
+        _frames.push_back(_current);
+        for (size_t i = 0; i < _current->fields.size(); i++)
+            _jobs.push_back(_current->fields[i]);
+        _current = NULL;
+
+        releaseFrames(lock);
+    }
+    _jobAdded.notify_all();
+}
+
+void FieldCache::flush() {
+    unique_lock<mutex> lock(_mutex);
+    while (_writing || !_frames.empty())
+        _frameDone.wait(lock);
+    fflush(_fp);
+}
@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef FIELDCACHEREADER_HPP_
+#define FIELDCACHEREADER_HPP_
+
+#include <vector>
+
+#include "FieldCacheFormat.hpp"
+
+/* Random access to a field cache written by FieldCache. The file is
+ * mapped rather than read, so only the tiles that are actually decoded
+ * are paged in. */
+class FieldCacheReader {
+    const unsigned char *_data;
+    uint64_t _size;
+    int _fd;
+
+    const CacheHeader *_header;
+    std::vector<uint64_t> _frames;
+
+    void buildIndex();
+    const unsigned char *frameBase(int frame) const;
+
+public:
+    FieldCacheReader(const char *path);
+    ~FieldCacheReader();
+
+    bool valid() const {
+        return _header != 0;
+    }
+
+    int tileSize() const {
+        return _header->tileSize;
+    }
+
+    int frameCount() const {
+        return _frames.size();
+    }
+
+    const CacheFrame &frame(int frame) const;
+    const CacheField &field(int frame, int field) const;
+    int findField(int frame, const char *name) const;
+
+    /* Writes the tile's values to dst with a row stride of stride floats.
+     * Edge tiles only cover the part of the tile inside the field */
+    void readTile(int frame, int field, int tx, int ty, float *dst, int stride) const;
+    void readField(int frame, int field, float *dst) const;
+};
+
+#endif /* FIELDCACHEREADER_HPP_ */
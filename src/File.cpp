@@ -37,6 +37,22 @@ int fsize(FILE *fp) {
     return size;
 }
 
+/* Grows with allocated blocks rather than a sparse hole. Only works on
+ * regular files */
+bool fresize(FILE *fp, long long size) {
+    struct stat info;
+    int file = fileno(fp);
+
+    fflush(fp);
+    if (fstat(file, &info) || !S_ISREG(info.st_mode))
+        return false;
+
+    if (size > info.st_size)
+        return posix_fallocate(file, 0, size) == 0;
+    else
+        return ftruncate(file, size) == 0;
+}
+
 time_t ftime(const char *path) {
     struct stat stat;
     int file = open(path, O_RDONLY);
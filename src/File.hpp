@@ -29,5 +29,6 @@ freely, subject to the following restrictions:
 
 time_t ftime(const char *path);
 int fsize(FILE *fp);
+bool fresize(FILE *fp, long long size);
 
 #endif /* FILE_HPP_ */
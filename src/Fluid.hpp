@@ -26,29 +26,149 @@ freely, subject to the following restrictions:
 
 #include "math/Vec4.hpp"
 
+#include <vector>
+
+/* Runs the CG solves as fused, tile-local compute kernels. Set to 0 to use
+ * the fragment pass implementation */
+#ifndef USE_COMPUTE_CG
+#define USE_COMPUTE_CG 1
+#endif
+
+/* Set to 1 to precondition the compute solver with a MIC(0) factorization
+ * of each tile's block of the assembled matrix instead of the fixed
+ * incomplete-Poisson stencil, which the fragment solver always uses. MIC
+ * needs fewer iterations, but its wavefront sweeps made the solve slower
+ * in every configuration measured so far, so it stays off by default */
+#ifndef USE_MIC_PRECONDITIONER
+#define USE_MIC_PRECONDITIONER 0
+#endif
+
+/* CG_PIPELINED merges both inner products of an iteration into a single
+ * reduction at the cost of two extra vector updates. Only the compute
+ * solver implements it */
+enum CgVariant {
+    CG_STANDARD,
+    CG_PIPELINED
+};
+
+/* ADVECT_PARTICLES carries the fields on particles. The grid schemes advect
+ * the fields directly instead: ADVECT_SEMI_LAGRANGIAN with a single RK3
+ * backtrace, ADVECT_MACCORMACK with an extra backward pass whose error
+ * estimate is added back under a limiter. All three share the cap on the
+ * step from the explicit forces, which is what limits the step in the
+ * default scene, so they run the same number of substeps there */
+enum AdvectionScheme {
+    ADVECT_PARTICLES,
+    ADVECT_SEMI_LAGRANGIAN,
+    ADVECT_MACCORMACK
+};
+
+/* TRANSFER_FLIP moves the particles by the change in the grid fields over a
+ * step, which needs a copy of the fields from before the solve.
+ * TRANSFER_APIC resamples the velocity outright and keeps its gradient on
+ * the particles as an affine term for the next splat, which makes do with
+ * fewer particles per cell. Density and temperature move as in FLIP */
+enum TransferScheme {
+    TRANSFER_FLIP,
+    TRANSFER_APIC
+};
+
+/* BIN_ATOMIC counts and buckets particles with one image atomic per
+ * particle each, which serializes on crowded cells. BIN_RADIX_SORT sorts
+ * the particles by cell instead and reads the counts and bucket slots off
+ * the sorted runs, so no counter is shared between particles. It fills
+ * buckets in index order, like the deterministic atomic path */
+enum BinningScheme {
+    BIN_ATOMIC,
+    BIN_RADIX_SORT
+};
+
+class AsyncReadback;
 class BufferObject;
-class RenderTarget;
+class EditQueue;
+class FramebufferCache;
+class StreamBuffer;
 class Texture;
 class Shader;
 
 class Fluid {
-    RenderTarget *_rt;
-    BufferObject *_blackPbo;
-
-    Shader *_matVecProduct, *_addSub, *_scaledAdd, *_advect, *_applyP;
+    static const int TileSize = 16;
+    /* Keys per radix sort block, one per invocation of a GROUP_SIZE group */
+    static const int SortBlockSize = TileSize*TileSize;
+    static const int StepConstantsBinding = 0;
+
+    enum TileList {
+        ActiveTiles,
+        InactiveTiles,
+        RetiredTiles,
+        TileListCount
+    };
+
+    /* Slots in the scalar buffer shared by the compute CG kernels */
+    enum ScalarSlot {
+        SigmaSlot0,
+        SigmaSlot1,
+        DotSlot,
+        GammaSlot,
+        AlphaSlot,
+        BetaSlot,
+        ScalarCount
+    };
+
+    /* Mirrors the std140 StepConstants block in the shader preamble */
+    struct StepConstants {
+        int pointInfo[2];
+        float timestep;
+        float invHx;
+        float pressureScale;
+        float heatScale;
+        float curlScale;
+        float pad;
+    };
+
+    /* Emitter box in domain units, placed by its centre */
+    struct Inflow {
+        float x, y, w, h;
+        float temperature;
+        int particles;
+    };
+
+    FramebufferCache *_fbos;
+    StreamBuffer *_stepConstants;
+    AsyncReadback *_maxVelocity;
+    AsyncReadback *_heatResidual, *_pressureResidual;
+    EditQueue *_edits;
+
+    Shader *_matVecProduct, *_addSub, *_scaledAdd, *_advect, *_macCormack, *_applyP;
     Shader *_buildPRhs, *_buildPMat, *_precon, *_divide, *_addReduce;
     Shader *_buildVorticity, *_confineV, *_addVorticity, *_buildHMat;
     Shader *_addBuoyancy, *_fastSweep, *_gather, *_clampCounts;
-    Shader *_particleAdvect, *_particleFromGrid, *_particleToGrid, *_particleRender;
-    Shader *_particleHisto, *_particleBucket, *_histoDownsample, *_histoUpsample;
+    Shader *_particleAdvect, *_particleFromGrid, *_particleFromGridAffine, *_particleToGrid, *_particleRender;
+    Shader *_particleHisto, *_particleBucket, *_stableBucket, *_histoDownsample, *_histoUpsample;
     Shader *_particleSpawn, *_set, *_maxReduce, *_calcVelocity, *_inflow, *_spawnInflow;
+    Shader *_obstacle, *_buildTiles, *_markTiles, *_compactTiles, *_buildPrecon;
+    Shader *_cgInit, *_cgMatVec, *_cgUpdate, *_cgDirection, *_cgReduce;
+    Shader *_pipelinedMatVec, *_pipelinedUpdate, *_pipelinedReduce, *_pipelinedPrecon;
+    Shader *_particleKeys, *_radixBlockSort, *_radixScatter, *_scan, *_scanAdd;
+    Shader *_cellRanges, *_sortedBucket;
 
     Texture *_dotPTransfer[2];
     Texture *_u, *_v, *_d, *_t, *_aDiag, *_aPlusX, *_aPlusY;
     Texture *_p, *_r, *_z, *_s, *_tmp1, *_tmp2, *_uTmp, *_vTmp, *_tTmp, *_dTmp;
+    Texture *_preconDiag;
     Texture *_particlePos, *_particleQ;
     Texture *_particlePosTmp, *_particleQTmp;
+    Texture *_particleGrad, *_particleGradTmp;
     Texture **_histoCount, **_histoIndex;
+    Texture *_bucketKeys[2];
+    Texture *_solid, *_tileMask, *_tileRaw, *_tileActivity[2];
+    Texture *_tileList[TileListCount], *_tileCounts;
+    BufferObject *_tileBuffer[TileListCount];
+    BufferObject *_tileCommands;
+    BufferObject *_partials, *_scalars;
+    BufferObject *_sortKeys[2], *_sortValues[2];
+    BufferObject *_digitCounts, *_digitStarts;
+    std::vector<BufferObject *> _scanSums;
 
     int _histoLevels;
 
@@ -59,72 +179,143 @@ class Fluid {
     int _particleCount;
     int _particleMax;
 
+    int _tilesX, _tilesY;
+    bool _solidDirty;
+    bool _deterministic;
+    bool _trackTiles;
+
     int _heatIters;
     int _pressureIters;
 
+    CgVariant _heatSolver;
+    CgVariant _pressureSolver;
+
+    AdvectionScheme _advection;
+    TransferScheme _transfer;
+    int _minPerCell, _maxPerCell;
+    BinningScheme _binning;
+    int _sortBits;
+    float _cfl;
+    float _maxTimestep;
+
     float _hX;
     float _density;
     float _diffusion;
     float _gravity;
     float _tAmb;
+    float _vorticity;
+
+    std::vector<Inflow> _inflows;
+
+    StepConstants _constants;
 
-    void makePreamble(const char *src, const char *dst);
+    void setStepConstants(float timestep);
+    void uploadStepConstants();
+    void makePreamble(const char *src, const char *computeSrc, const char *dst, const char *computeDst);
 
     void particleQuad(Shader &s);
     void shaderQuad(Shader &s, int x, int y, int w, int h);
     void shaderLoop(Shader &s, int x, int y, int w, int h);
-    void shaderQuad(Shader &s, int x, int y, int w, int h, int vx, int vy, int vw, int vh, bool filled = true);
+    void shaderQuad(Shader &s, int x, int y, int w, int h, int vx, int vy, int vw, int vh, bool filled = true, int tiles = -1);
+    void shaderGrid(Shader &s, int w, int h);
+    void fillTiles(Texture &dst, float value, TileList list);
+    void bindSolid(Shader &s);
+    void bindMatrix(Shader &s);
+    void dispatchTiles(Shader &s);
+    void reduceTiles(int dst);
+    void reducePipelined(bool first);
+    void pipelinedMatVec();
 
     void parallelReduce(Shader &s, Texture &src, Texture &target, int subdiv);
     void addReduce(Texture &src, Texture &target);
     float maxReduce(Texture &src, Texture &target);
+    void queueMaxVelocity();
+    void beginPasses();
+    void endPasses();
 
-
-    void advect(Texture &src, Texture &dst, float timestep, float offX, float offY, int w, int h);
+    void advect(Texture &src, Texture &dst, float offX, float offY, int w, int h, float direction);
+    void macCormack(Texture &src, Texture &forward, Texture &backward, Texture &dst, float offX, float offY, int w, int h);
+    void advectGrid();
+    void advectParticles();
 
     void buildPRhs(Texture &rhs);
-    void buildPMat(float timestep);
-    void buildHMat(float timestep);
+    void buildPMat();
+    void buildHMat();
+    void buildPreconditioner();
 
     void matVecProduct(Texture &aDiag, Texture &aPlusX, Texture &aPlusY, Texture &b, Texture &result, Texture &ab);
     void addSub(Texture &subA, Texture &subB, Texture &addA, Texture &addB, Texture &dstSub, Texture &dstAdd, Texture &alpha, Texture &beta);
     void scaledAdd(Texture &addA, Texture &addB, Texture &dst, Texture &alpha, Texture &beta);
     void applyPreconditioner(Texture &r, Texture &z, Texture &ab);
-    void conjugateGradients(int &iters);
+    void adaptIterations(int &iters, float residual);
+    void checkResidual(int &iters, AsyncReadback &residual, Texture &target);
+    void fragmentConjugateGradients(int &iters, AsyncReadback &residual);
+    void computeConjugateGradients(int &iters, AsyncReadback &residual);
+    void pipelinedConjugateGradients(int &iters, AsyncReadback &residual);
+    void conjugateGradients(int &iters, CgVariant variant, AsyncReadback &residual);
 
-    void applyPressure(Texture &p, Texture &dstU, Texture &dstV, float timestep);
+    void applyPressure(Texture &p, Texture &dstU, Texture &dstV);
 
     void calcVelocity(Texture &target);
     void buildVorticity(Texture &dst);
     void confineVorticity(float epsilon, Texture &src, Texture &dstU, Texture &dstV);
-    void addVorticity(float timestep, Texture &srcU, Texture &srcV, Texture &dstU, Texture &dstV);
-    void addBuoyancy(float timestep, Texture &dstV);
+    void addVorticity(Texture &srcU, Texture &srcV, Texture &dstU, Texture &dstV);
+    void addBuoyancy(Texture &dstV);
+
+    int addInflow(float x, float y, float w, float h, int pAmount, int spawned, const Vec4 &qMin, const Vec4 &qVal);
+    void applyEdits();
 
-    int addInflow(float x, float y, float w, float h, int pAmount, const Vec4 &qMin, const Vec4 &qVal);
+    void rasterizeSolid(float x, float y, float w, float h, float radius);
+    void updateSolidTiles();
+    void updateTiles();
 
-    void particleAdvect(float timestep);
+    void bindParticleGradients(Shader &s, bool images);
+    void particleAdvect();
     void particleToGrid();
     void particleFromGrid(Texture &q);
     void particleExtrapolate(Texture &q, Texture &w);
     void particleCount();
     void particleBucket();
+    void stableParticleBucket();
+    void sortedParticleBucket();
+    void sortParticles();
+    void scanDigits(BufferObject &data, int count, int level);
     void particleSpawn();
 
     void histoPyramid();
 
-    void clear(Texture &a);
     void copy(Texture &dst, Texture &src);
 
 public:
     Fluid(int width, int height);
 
     void initScene();
+    void addSolidBox(float x, float y, float w, float h);
+    void addSolidCircle(float x, float y, float r);
+    void clearSolids();
+    void setSolvers(CgVariant heat, CgVariant pressure);
+    void setAdvection(AdvectionScheme scheme);
+    void setTransfer(TransferScheme scheme);
+    void setBinning(BinningScheme scheme);
+    void setDeterministic(bool deterministic);
+    void setTileTracking(bool track);
     void update(float timestep);
     float recommendedTimestep();
+    float estimatedTimestep();
+    float maxTimestep();
 
     void setup();
     void teardown();
 
+    EditQueue *edits() {
+        return _edits;
+    }
+
+    /* Live particles as counted by the last update */
+    int particles() const {
+        return _particleCount;
+    }
+
     Texture *density() {
         return _d;
     }
@@ -144,6 +335,10 @@ public:
     Texture *p() {
         return _p;
     }
+
+    Texture *solid() {
+        return _solid;
+    }
 };
 
 #endif /* FLUID_HPP_ */
@@ -0,0 +1,593 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#include <algorithm>
+#include <GL/glew.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "Fluid3D.hpp"
+#include "render/BufferObject.hpp"
+#include "render/Texture.hpp"
+#include "render/Shader.hpp"
+#include "SlabSolver.hpp"
+#include "Debug.hpp"
+#include "File.hpp"
+
+using namespace std;
+
+Fluid3D::Fluid3D(int width, int height, int depth) : _width(width), _height(height), _depth(depth) {
+    _cells = _width*_height*_depth;
+
+    makePreamble("src/shaders/Preamble.txt", "src/shaders/Fluid3D/Preamble.txt");
+
+    _hX = 1.0/min(_width, min(_height, _depth));
+    _density   = 1.0;
+    _diffusion = 0.05;
+    _gravity   = -9.81;
+    _tAmb      = 22.0;
+    _vorticityScale = 1.0;
+
+    _heatIters     = 40;
+    _pressureIters = 80;
+
+    _seed = 0;
+
+    _slabSolver = 0;
+
+    _groupsX = (_width  - 1)/8 + 1;
+    _groupsY = (_height - 1)/8 + 1;
+    _groupsZ = (_depth  - 1)/4 + 1;
+
+    ASSERT((_cells*MaxPerCell - 1)/GroupSize + 1 <= 65535, "Too many particles for a single dispatch\n");
+
+    _particleAdvect   = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "ParticleAdvect.comp");
+    _particleSpawn    = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "ParticleSpawn.comp");
+    _particleToGrid   = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "ParticleToGrid.comp");
+    _particleFromGrid = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "ParticleFromGrid.comp");
+    _extrapolate      = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "Extrapolate.comp");
+    _vorticity        = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "Vorticity.comp");
+    _addVorticity     = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "AddVorticity.comp");
+    _addBuoyancy      = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "AddBuoyancy.comp");
+    _buildRhs         = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "BuildPressureRhs.comp");
+    _applyP           = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "ApplyPressure.comp");
+    _cgInit           = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "CgInit.comp");
+    _matVec           = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "MatVecProduct.comp");
+    _cgUpdate         = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "CgUpdate.comp");
+    _cgDirection      = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "CgDirection.comp");
+    _reduce           = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "Reduce.comp");
+    _maxReduce        = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "MaxReduce.comp");
+    _calcVelocity     = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "CalcVelocity.comp");
+    _inflow           = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "Inflow.comp");
+    _projectDensity   = new Shader("src/shaders/Fluid3D/", "Preamble.txt", "ProjectDensity.comp");
+
+    Texture **ts[] = {
+        &_u, &_v, &_w, &_d, &_t, &_uOld, &_vOld, &_wOld, &_dOld, &_tOld,
+        &_p, &_r, &_z, &_s, &_q, &_tmp
+    };
+    for (int i = 0; i < 16; i++) {
+        *(ts[i]) = new Texture(TEXTURE_3D, _width, _height, _depth);
+        (*(ts[i]))->setFormat(TEXEL_FLOAT, 1, 4);
+        (*(ts[i]))->init();
+    }
+
+    _omega = new Texture(TEXTURE_3D, _width, _height, _depth);
+    _omega->setFormat(TEXEL_FLOAT, 4, 4);
+    _omega->init();
+
+    _projection = new Texture(TEXTURE_2D, _width, _height);
+    _projection->setFormat(TEXEL_FLOAT, 1, 4);
+    _projection->init();
+
+    for (int i = 0; i < 2; i++) {
+        _particles[i] = new BufferObject(SHADER_STORAGE_BUFFER, _cells*MaxPerCell*8*sizeof(float));
+        _counts[i]    = new BufferObject(SHADER_STORAGE_BUFFER, _cells*sizeof(uint32_t));
+    }
+
+    _partials = new BufferObject(SHADER_STORAGE_BUFFER, _groupsX*_groupsY*_groupsZ*sizeof(float));
+    _scalars  = new BufferObject(SHADER_STORAGE_BUFFER, ScalarCount*sizeof(float));
+
+    printf("Texture memory usage: %dmb, particle memory usage: %dmb\n",
+        (int)(Texture::memoryUsage()/(1024*1024)),
+        (int)(((unsigned long long int)_cells)*MaxPerCell*8*sizeof(float)*2/(1024*1024)));
+}
+
+void Fluid3D::decompose(int slabs) {
+    ASSERT(_slabSolver == 0, "Solver is already decomposed\n");
+
+    _slabSolver = new SlabSolver(_width, _height, _depth, slabs);
+}
+
+void Fluid3D::makePreamble(const char *src, const char *dst) {
+    static char text[4*1024], preamble[8*1024];
+
+    FILE *fp = fopen(src, "rb");
+    fread(text, 1, fsize(fp), fp);
+    fclose(fp);
+
+    sprintf(preamble,
+        "%s\n"
+        "#define WIDTH          %d\n"
+        "#define HEIGHT         %d\n"
+        "#define DEPTH          %d\n"
+        "#define CELLS          %d\n"
+        "#define MIN_PER_CELL   %d\n"
+        "#define MAX_PER_CELL   %d\n"
+        "#define GROUP_SIZE     %d\n"
+        "#define DOT_SLOT       %d\n"
+        "struct Particle {\n"
+        "    vec4 pos; /* xyz position, w density */\n"
+        "    vec4 q;   /* xyz velocity, w temperature */\n"
+        "};\n"
+        "layout(std430, binding = 4) buffer Partials {\n"
+        "    float partials[];\n"
+        "};\n"
+        "layout(std430, binding = 5) buffer Scalars {\n"
+        "    float scalars[];\n"
+        "};\n"
+        "shared float reduction[GROUP_SIZE];\n"
+        "bool fluidCell(ivec3 coord) {\n"
+        "    return all(greaterThanEqual(coord, ivec3(0))) && all(lessThan(coord, ivec3(WIDTH - 1, HEIGHT - 1, DEPTH - 1)));\n"
+        "}\n"
+        "bool insideGrid(ivec3 coord) {\n"
+        "    return all(lessThan(coord, ivec3(WIDTH, HEIGHT, DEPTH)));\n"
+        "}\n"
+        "int cellIndex(ivec3 coord) {\n"
+        "    return coord.x + WIDTH*(coord.y + HEIGHT*coord.z);\n"
+        "}\n"
+        "float fluidNeighbours(ivec3 coord) {\n"
+        "    return float(fluidCell(coord + ivec3(1, 0, 0))) + float(fluidCell(coord - ivec3(1, 0, 0))) +\n"
+        "           float(fluidCell(coord + ivec3(0, 1, 0))) + float(fluidCell(coord - ivec3(0, 1, 0))) +\n"
+        "           float(fluidCell(coord + ivec3(0, 0, 1))) + float(fluidCell(coord - ivec3(0, 0, 1)));\n"
+        "}\n"
+        "void reduceGroup(float value, int mode) {\n"
+        "    uint i = gl_LocalInvocationIndex;\n"
+        "    reduction[i] = value;\n"
+        "    barrier();\n"
+        "    for (uint s = GROUP_SIZE/2; s > 0; s >>= 1) {\n"
+        "        if (i < s)\n"
+        "            reduction[i] = (mode == 0 ? reduction[i] + reduction[i + s] : max(reduction[i], reduction[i + s]));\n"
+        "        barrier();\n"
+        "    }\n"
+        "    if (i == 0)\n"
+        "        partials[gl_WorkGroupID.x + gl_NumWorkGroups.x*(gl_WorkGroupID.y + gl_NumWorkGroups.y*gl_WorkGroupID.z)] = reduction[0];\n"
+        "}\n",
+        text,
+        _width,
+        _height,
+        _depth,
+        _cells,
+        MinPerCell,
+        MaxPerCell,
+        GroupSize,
+        DotSlot
+    );
+
+    fp = fopen(dst, "wb");
+    fwrite(preamble, 1, strlen(preamble), fp);
+    fclose(fp);
+}
+
+void Fluid3D::dispatchGrid(Shader &s) {
+    s.dispatch(_groupsX, _groupsY, _groupsZ);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void Fluid3D::dispatchParticles(Shader &s) {
+    s.dispatch((_cells*MaxPerCell - 1)/GroupSize + 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void Fluid3D::bindParticles() {
+    _particles[0]->bindIndexed(0);
+    _counts[0]->bindIndexed(1);
+    _particles[1]->bindIndexed(2);
+    _counts[1]->bindIndexed(3);
+    _partials->bindIndexed(4);
+    _scalars->bindIndexed(5);
+}
+
+float Fluid3D::readScalar(int slot) {
+    float value;
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    _scalars->bind();
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, slot*sizeof(float), sizeof(float), &value);
+    _scalars->unbind();
+
+    return value;
+}
+
+float Fluid3D::maxReduce(Texture &src) {
+    src.bindAny();
+    _maxReduce->bind();
+    _maxReduce->uniformI("Src", src.boundUnit());
+    dispatchGrid(*_maxReduce);
+
+    _reduce->bind();
+    _reduce->uniformI("Count", _groupsX*_groupsY*_groupsZ);
+    _reduce->uniformI("Dst", MaxSlot);
+    _reduce->uniformI("Mode", ReduceMax);
+    _reduce->dispatch(1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    return readScalar(MaxSlot);
+}
+
+void Fluid3D::particleAdvect(float timestep) {
+    uint32_t zero = 0;
+    _counts[1]->bind();
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    _counts[1]->unbind();
+
+    _u->bindAny();
+    _v->bindAny();
+    _w->bindAny();
+
+    _particleAdvect->bind();
+    _particleAdvect->uniformI("U", _u->boundUnit());
+    _particleAdvect->uniformI("V", _v->boundUnit());
+    _particleAdvect->uniformI("W", _w->boundUnit());
+    _particleAdvect->uniformF("Timestep", timestep);
+    _particleAdvect->uniformF("InvHx", 1.0/_hX);
+    dispatchParticles(*_particleAdvect);
+
+    swap(_particles[0], _particles[1]);
+    swap(_counts[0], _counts[1]);
+    bindParticles();
+}
+
+void Fluid3D::particleSpawn() {
+    _particleSpawn->bind();
+    _particleSpawn->uniformI("Seed", _seed++);
+    dispatchGrid(*_particleSpawn);
+}
+
+void Fluid3D::particleToGrid() {
+    Texture *qs[] = {_d, _t, _u, _v, _w};
+    const char *names[] = {"D", "T", "U", "V", "W"};
+
+    _particleToGrid->bind();
+    for (int i = 0; i < 5; i++) {
+        qs[i]->bindImage(i, false, true);
+        _particleToGrid->uniformI(names[i], i);
+    }
+    dispatchGrid(*_particleToGrid);
+}
+
+void Fluid3D::particleFromGrid() {
+    Texture *qs[] = {_d, _t, _u, _v, _w, _dOld, _tOld, _uOld, _vOld, _wOld};
+    const char *names[] = {"D", "T", "U", "V", "W", "DOld", "TOld", "UOld", "VOld", "WOld"};
+
+    _particleFromGrid->bind();
+    for (int i = 0; i < 10; i++) {
+        qs[i]->bindAny();
+        _particleFromGrid->uniformI(names[i], qs[i]->boundUnit());
+    }
+    dispatchParticles(*_particleFromGrid);
+}
+
+void Fluid3D::extrapolate(Texture &q, float rest) {
+    _extrapolate->bind();
+    _extrapolate->uniformF("Rest", rest);
+    for (int i = 0; i < 10; i++) {
+        Texture &src = (i & 1 ? *_tmp : q);
+        Texture &dst = (i & 1 ? q : *_tmp);
+
+        src.bindAny();
+        dst.bindImage(0, false, true);
+        _extrapolate->uniformI("Src", src.boundUnit());
+        _extrapolate->uniformI("Dst", 0);
+        _extrapolate->uniformI("Final", i == 9);
+        dispatchGrid(*_extrapolate);
+    }
+}
+
+void Fluid3D::addVorticity(float timestep) {
+    _u->bindAny();
+    _v->bindAny();
+    _w->bindAny();
+    _omega->bindImage(0, false, true);
+
+    _vorticity->bind();
+    _vorticity->uniformI("U", _u->boundUnit());
+    _vorticity->uniformI("V", _v->boundUnit());
+    _vorticity->uniformI("W", _w->boundUnit());
+    _vorticity->uniformI("Omega", 0);
+    _vorticity->uniformF("Scale", 0.5/_hX);
+    dispatchGrid(*_vorticity);
+
+    _omega->bindAny();
+    _u->bindImage(0);
+    _v->bindImage(1);
+    _w->bindImage(2);
+
+    _addVorticity->bind();
+    _addVorticity->uniformI("Omega", _omega->boundUnit());
+    _addVorticity->uniformI("U", 0);
+    _addVorticity->uniformI("V", 1);
+    _addVorticity->uniformI("W", 2);
+    _addVorticity->uniformF("Scale", 0.5/_hX);
+    _addVorticity->uniformF("Hx", _hX);
+    _addVorticity->uniformF("Epsilon", _vorticityScale);
+    _addVorticity->uniformF("Timestep", timestep);
+    dispatchGrid(*_addVorticity);
+}
+
+void Fluid3D::addBuoyancy(float timestep) {
+    _t->bindAny();
+    _v->bindImage(0);
+
+    _addBuoyancy->bind();
+    _addBuoyancy->uniformI("T", _t->boundUnit());
+    _addBuoyancy->uniformI("V", 0);
+    _addBuoyancy->uniformF("Timestep", timestep);
+    _addBuoyancy->uniformF("G", _gravity);
+    _addBuoyancy->uniformF("Density", _density);
+    _addBuoyancy->uniformF("TAmb", _tAmb);
+    dispatchGrid(*_addBuoyancy);
+}
+
+/* Matrix-free Jacobi-preconditioned CG on A = Base*I - Scale*Laplacian.
+ * The solution ends up in _p; alpha/beta never leave the GPU. */
+void Fluid3D::conjugateGradients(Texture &b, float base, float scale, int &iters) {
+    if (_slabSolver) {
+        _slabSolver->solve(b, *_p, base, scale, iters);
+        return;
+    }
+
+    int groups = _groupsX*_groupsY*_groupsZ;
+    int sigma = SigmaSlot0, sigmaN = SigmaSlot1;
+
+    copy(*_r, b);
+
+    _p->bindImage(0);
+    _r->bindImage(1);
+    _z->bindImage(2);
+    _s->bindImage(3);
+    _q->bindImage(4);
+
+    _reduce->bind();
+    _reduce->uniformI("Count", groups);
+    _reduce->uniformI("Mode", ReduceSum);
+
+    _cgInit->bind();
+    _cgInit->uniformI("Slab", 0, _height, 0);
+    _cgInit->uniformI("P", 0);
+    _cgInit->uniformI("R", 1);
+    _cgInit->uniformI("Z", 2);
+    _cgInit->uniformI("S", 3);
+    _cgInit->uniformF("Base", base);
+    _cgInit->uniformF("Scale", scale);
+    dispatchGrid(*_cgInit);
+
+    _reduce->bind();
+    _reduce->uniformI("Dst", sigma);
+    _reduce->dispatch(1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    _matVec->bind();
+    _matVec->uniformI("Slab", 0, _height, 0);
+    _matVec->uniformI("S", 3);
+    _matVec->uniformI("Q", 4);
+    _matVec->uniformF("Base", base);
+    _matVec->uniformF("Scale", scale);
+
+    _cgUpdate->bind();
+    _cgUpdate->uniformI("Slab", 0, _height, 0);
+    _cgUpdate->uniformI("P", 0);
+    _cgUpdate->uniformI("R", 1);
+    _cgUpdate->uniformI("Z", 2);
+    _cgUpdate->uniformI("S", 3);
+    _cgUpdate->uniformI("Q", 4);
+    _cgUpdate->uniformF("Base", base);
+    _cgUpdate->uniformF("Scale", scale);
+
+    _cgDirection->bind();
+    _cgDirection->uniformI("Slab", 0, _height, 0);
+    _cgDirection->uniformI("Z", 2);
+    _cgDirection->uniformI("S", 3);
+
+    for (int i = 0; i < iters; i++) {
+        _matVec->bind();
+        dispatchGrid(*_matVec);
+
+        _reduce->bind();
+        _reduce->uniformI("Dst", DotSlot);
+        _reduce->dispatch(1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        _cgUpdate->bind();
+        _cgUpdate->uniformI("Sigma", sigma);
+        dispatchGrid(*_cgUpdate);
+
+        _reduce->bind();
+        _reduce->uniformI("Dst", sigmaN);
+        _reduce->dispatch(1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        _cgDirection->bind();
+        _cgDirection->uniformI("Sigma", sigma);
+        _cgDirection->uniformI("SigmaN", sigmaN);
+        dispatchGrid(*_cgDirection);
+
+        swap(sigma, sigmaN);
+
+        if (i == iters - 1) {
+            float residual = maxReduce(*_r);
+            if (residual > 1e-2)
+                iters = min(iters + 10, 4000);
+            else {
+                iters = max(iters - 1, 10);
+                printf("Residual error: %f, iters %d\n", residual, iters);
+            }
+        }
+    }
+}
+
+void Fluid3D::solvePressure(float timestep) {
+    _u->bindAny();
+    _v->bindAny();
+    _w->bindAny();
+    _tmp->bindImage(0, false, true);
+
+    _buildRhs->bind();
+    _buildRhs->uniformI("U", _u->boundUnit());
+    _buildRhs->uniformI("V", _v->boundUnit());
+    _buildRhs->uniformI("W", _w->boundUnit());
+    _buildRhs->uniformI("Rhs", 0);
+    _buildRhs->uniformF("InvHx", 1.0);
+    dispatchGrid(*_buildRhs);
+
+    conjugateGradients(*_tmp, 0.0, timestep/_density*1.0/_hX, _pressureIters);
+
+    _p->bindAny();
+    _u->bindImage(0);
+    _v->bindImage(1);
+    _w->bindImage(2);
+
+    _applyP->bind();
+    _applyP->uniformI("P", _p->boundUnit());
+    _applyP->uniformI("U", 0);
+    _applyP->uniformI("V", 1);
+    _applyP->uniformI("W", 2);
+    _applyP->uniformF("Scale", timestep/_density*1.0/_hX);
+    dispatchGrid(*_applyP);
+}
+
+void Fluid3D::addInflow(float x, float y, float z, float w, float h, float d, float dVal, float tVal) {
+    _d->bindImage(0);
+    _t->bindImage(1);
+
+    _inflow->bind();
+    _inflow->uniformI("D", 0);
+    _inflow->uniformI("T", 1);
+    _inflow->uniformF("Origin", x/_hX, y/_hX, z/_hX);
+    _inflow->uniformF("Size", w/_hX, h/_hX, d/_hX);
+    _inflow->uniformF("DValue", dVal);
+    _inflow->uniformF("TValue", tVal);
+    _inflow->uniformF("TAmb", _tAmb);
+    _inflow->uniformI("Seed", _seed++);
+    dispatchGrid(*_inflow);
+}
+
+void Fluid3D::copy(Texture &dst, Texture &src) {
+    glCopyImageSubData(src.glName(), GL_TEXTURE_3D, 0, 0, 0, 0,
+                       dst.glName(), GL_TEXTURE_3D, 0, 0, 0, 0, _width, _height, _depth);
+}
+
+void Fluid3D::initScene() {
+    float *zeros   = new float[_cells];
+    float *ambient = new float[_cells];
+
+    for (int i = 0; i < _cells; i++) {
+        zeros[i] = 0.0;
+        ambient[i] = _tAmb;
+    }
+
+    Texture *qs[] = {_u, _v, _w, _d, _uOld, _vOld, _wOld, _dOld, _p};
+    for (int i = 0; i < 9; i++)
+        qs[i]->copy(zeros);
+    _t->copy(ambient);
+    _tOld->copy(ambient);
+
+    delete[] zeros;
+    delete[] ambient;
+
+    uint32_t zero = 0;
+    _counts[0]->bind();
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    _counts[0]->unbind();
+
+    bindParticles();
+    particleSpawn();
+    particleFromGrid();
+}
+
+void Fluid3D::update(float timestep) {
+    bindParticles();
+
+    particleAdvect(timestep);
+    particleSpawn();
+    particleToGrid();
+
+    extrapolate(*_d, 0.0);
+    extrapolate(*_t, _tAmb);
+    extrapolate(*_u, 0.0);
+    extrapolate(*_v, 0.0);
+    extrapolate(*_w, 0.0);
+
+    copy(*_uOld, *_u);
+    copy(*_vOld, *_v);
+    copy(*_wOld, *_w);
+    copy(*_tOld, *_t);
+    copy(*_dOld, *_d);
+
+    addVorticity(timestep);
+
+    conjugateGradients(*_tOld, 1.0, timestep*_diffusion*1.0/(_hX*_hX), _heatIters);
+    swap(_t, _p);
+    addBuoyancy(timestep);
+
+    solvePressure(timestep);
+
+    addInflow(0.35, 0.05, 0.35, 0.3, 0.05, 0.3, 1.0, 200.0);
+
+    particleFromGrid();
+}
+
+float Fluid3D::recommendedTimestep() {
+    _u->bindAny();
+    _v->bindAny();
+    _w->bindAny();
+    _tmp->bindImage(0, false, true);
+
+    _calcVelocity->bind();
+    _calcVelocity->uniformI("U", _u->boundUnit());
+    _calcVelocity->uniformI("V", _v->boundUnit());
+    _calcVelocity->uniformI("W", _w->boundUnit());
+    _calcVelocity->uniformI("Dst", 0);
+    dispatchGrid(*_calcVelocity);
+
+    bindParticles();
+    float maxU = maxReduce(*_tmp);
+
+    return 2.0/maxU;
+}
+
+Texture *Fluid3D::projection() {
+    _d->bindAny();
+    _projection->bindImage(0, false, true);
+
+    _projectDensity->bind();
+    _projectDensity->uniformI("D", _d->boundUnit());
+    _projectDensity->uniformI("Dst", 0);
+    _projectDensity->uniformF("Absorption", 8.0*_hX);
+    _projectDensity->dispatch(_groupsX, _groupsY);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    return _projection;
+}
@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+
+#ifndef FLUID3D_HPP_
+#define FLUID3D_HPP_
+
+class SlabSolver;
+class BufferObject;
+class Texture;
+class Shader;
+
+/* Slots in the scalar buffer shared by the CG kernels */
+enum ScalarSlot {
+    SigmaSlot0,
+    SigmaSlot1,
+    DotSlot,
+    MaxSlot,
+    ScalarCount
+};
+
+enum ReduceMode {
+    ReduceSum,
+    ReduceMax
+};
+
+class Fluid3D {
+    static const int MinPerCell = 4;
+    static const int MaxPerCell = 8;
+    static const int GroupSize  = 256;
+
+    Shader *_particleAdvect, *_particleSpawn, *_particleToGrid, *_particleFromGrid;
+    Shader *_extrapolate, *_vorticity, *_addVorticity, *_addBuoyancy;
+    Shader *_buildRhs, *_applyP, *_cgInit, *_matVec, *_cgUpdate, *_cgDirection;
+    Shader *_reduce, *_maxReduce, *_calcVelocity, *_inflow, *_projectDensity;
+
+    Texture *_u, *_v, *_w, *_d, *_t;
+    Texture *_uOld, *_vOld, *_wOld, *_dOld, *_tOld;
+    Texture *_p, *_r, *_z, *_s, *_q, *_tmp, *_omega;
+    Texture *_projection;
+
+    BufferObject *_particles[2], *_counts[2];
+    BufferObject *_partials, *_scalars;
+
+    SlabSolver *_slabSolver;
+
+    int _width, _height, _depth;
+    int _cells;
+    int _groupsX, _groupsY, _groupsZ;
+    int _seed;
+
+    int _heatIters;
+    int _pressureIters;
+
+    float _hX;
+    float _density;
+    float _diffusion;
+    float _gravity;
+    float _tAmb;
+    float _vorticityScale;
+
+    void makePreamble(const char *src, const char *dst);
+
+    void dispatchGrid(Shader &s);
+    void dispatchParticles(Shader &s);
+    void bindParticles();
+
+    float readScalar(int slot);
+    float maxReduce(Texture &src);
+
+    void particleAdvect(float timestep);
+    void particleSpawn();
+    void particleToGrid();
+    void particleFromGrid();
+    void extrapolate(Texture &q, float rest);
+
+    void addVorticity(float timestep);
+    void addBuoyancy(float timestep);
+
+    void conjugateGradients(Texture &b, float base, float scale, int &iters);
+    void solvePressure(float timestep);
+
+    void addInflow(float x, float y, float z, float w, float h, float d, float dVal, float tVal);
+
+    void copy(Texture &dst, Texture &src);
+
+public:
+    Fluid3D(int width, int height, int depth);
+
+    void decompose(int slabs);
+
+    void initScene();
+    void update(float timestep);
+    float recommendedTimestep();
+
+    Texture *projection();
+
+    Texture *density() {
+        return _d;
+    }
+
+    Texture *u() {
+        return _u;
+    }
+
+    Texture *v() {
+        return _v;
+    }
+
+    Texture *w() {
+        return _w;
+    }
+
+    Texture *t() {
+        return _t;
+    }
+};
+
+#endif /* FLUID3D_HPP_ */
@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include <algorithm>
+
+#include "FrameExchange.hpp"
+#include "render/Texture.hpp"
+#include "Debug.hpp"
+
+using namespace std;
+
+FrameExchange::FrameExchange(int fieldCount) : _fieldCount(fieldCount), _back(0), _ready(1), _front(2), _fresh(false) {
+    ASSERT(fieldCount <= MaxFields, "Too many fields in frame exchange: %d\n", fieldCount);
+
+    for (int i = 0; i < SlotCount; i++) {
+        for (int t = 0; t < MaxFields; t++)
+            _slots[i].fields[t] = 0;
+        _slots[i].written = 0;
+        _slots[i].drawn = 0;
+        _slots[i].frame = -1;
+    }
+}
+
+FrameExchange::~FrameExchange() {
+    for (int i = 0; i < SlotCount; i++) {
+        for (int t = 0; t < _fieldCount; t++)
+            delete _slots[i].fields[t];
+        if (_slots[i].written)
+            glDeleteSync(_slots[i].written);
+        if (_slots[i].drawn)
+            glDeleteSync(_slots[i].drawn);
+    }
+}
+
+/* Simulation thread: copies the fields into the back set and swaps it with
+ * the published one */
+void FrameExchange::publish(Texture **fields, int frame) {
+    Slot &s = _slots[_back];
+
+    if (!s.fields[0]) {
+        for (int t = 0; t < _fieldCount; t++) {
+            s.fields[t] = new Texture(TEXTURE_2D, fields[t]->width(), fields[t]->height());
+            s.fields[t]->setFormat(fields[t]->texelType(), fields[t]->channels(), fields[t]->bpChannel());
+            s.fields[t]->init();
+        }
+    }
+
+    /* The display may still be drawing from the set it last gave back */
+    if (s.drawn) {
+        glWaitSync(s.drawn, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(s.drawn);
+        s.drawn = 0;
+    }
+
+    /* Fields may have been written through image stores */
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    for (int t = 0; t < _fieldCount; t++)
+        glCopyImageSubData(fields[t]->glName(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                           s.fields[t]->glName(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                           fields[t]->width(), fields[t]->height(), 1);
+
+    /* A set that was published but never picked up comes back unwaited */
+    if (s.written)
+        glDeleteSync(s.written);
+    s.written = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s.frame = frame;
+
+    /* The other context can only see the fence once it has been flushed */
+    glFlush();
+
+    lock_guard<mutex> lock(_mutex);
+    swap(_back, _ready);
+    _fresh = true;
+}
+
+/* Display thread: takes the newest published set, if there is a new one.
+ * Returns false until the first frame has been published */
+bool FrameExchange::acquire() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_fresh) {
+            swap(_front, _ready);
+            _fresh = false;
+        }
+    }
+
+    Slot &s = _slots[_front];
+    if (s.written) {
+        glWaitSync(s.written, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(s.written);
+        s.written = 0;
+    }
+
+    return s.frame >= 0;
+}
+
+/* Display thread: marks the end of the draws from the acquired set */
+void FrameExchange::release() {
+    Slot &s = _slots[_front];
+
+    if (s.drawn)
+        glDeleteSync(s.drawn);
+    s.drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+GLuint FrameExchange::field(int index) const {
+    return _slots[_front].fields[index]->glName();
+}
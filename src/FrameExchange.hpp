@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef FRAMEEXCHANGE_HPP_
+#define FRAMEEXCHANGE_HPP_
+
+#include <GL/glew.h>
+#include <mutex>
+
+class Texture;
+
+/* Hands finished frames from the simulation thread to the display thread
+ * through three sets of textures in a shared context. The simulation
+ * copies into the back set and publishes it, the display takes whichever
+ * set was published last, so neither side ever waits on the other. Fences
+ * order the copies against the draws on the GPU.
+ *
+ * The textures are created and filled on the simulation thread. The
+ * display thread only binds them by name, since the texture unit
+ * bookkeeping in Texture belongs to a single context. */
+class FrameExchange {
+    static const int SlotCount = 3;
+    static const int MaxFields = 8;
+
+    struct Slot {
+        Texture *fields[MaxFields];
+        GLsync written;
+        GLsync drawn;
+        int frame;
+    };
+
+    Slot _slots[SlotCount];
+    int _fieldCount;
+
+    std::mutex _mutex;
+    int _back, _ready, _front;
+    bool _fresh;
+
+public:
+    FrameExchange(int fieldCount);
+    ~FrameExchange();
+
+    void publish(Texture **fields, int frame);
+
+    bool acquire();
+    void release();
+
+    GLuint field(int index) const;
+
+    int frame() const {
+        return _slots[_front].frame;
+    }
+};
+
+#endif /* FRAMEEXCHANGE_HPP_ */
@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include <GL/glew.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "FrameStream.hpp"
+#include "render/BufferObject.hpp"
+#include "render/Texture.hpp"
+#include "Debug.hpp"
+#include "File.hpp"
+
+FrameStream::FrameStream(const char *path, FrameFormat format, int width, int height, int maxFrames) :
+        _width(width), _height(height), _maxFrames(maxFrames), _frameCount(0),
+        _head(0), _pending(0) {
+    int pixelSize = 0;
+    switch (format) {
+    case FRAME_GRAY8:   _glFormat = GL_RED;  _glType = GL_UNSIGNED_BYTE; pixelSize = 1; break;
+    case FRAME_RGB24:   _glFormat = GL_RGB;  _glType = GL_UNSIGNED_BYTE; pixelSize = 3; break;
+    case FRAME_RGBA16F: _glFormat = GL_RGBA; _glType = GL_HALF_FLOAT;    pixelSize = 8; break;
+    default:
+        FAIL("Unknown frame format %d\n", format);
+    }
+    _frameSize = width*height*pixelSize;
+
+    if (strcmp(path, "-") == 0) {
+        /* Frames take over stdout, so console output moves to stderr */
+        fflush(stdout);
+        int fd = dup(fileno(stdout));
+        dup2(fileno(stderr), fileno(stdout));
+        _fp = fdopen(fd, "wb");
+    } else
+        _fp = fopen(path, "wb");
+    ASSERT(_fp != NULL, "Unable to open frame stream %s\n", path);
+
+    /* Fails harmlessly on pipes, which then just grow as usual */
+    _preallocated = maxFrames > 0 && fresize(_fp, (long long)maxFrames*_frameSize);
+
+    for (int i = 0; i < ReadbackDepth; i++) {
+        _pbos[i] = new BufferObject(PIXEL_PACK_BUFFER);
+        _pbos[i]->bind();
+        _pbos[i]->copyData(NULL, _frameSize, GL_STREAM_READ);
+        _pbos[i]->unbind();
+    }
+}
+
+FrameStream::~FrameStream() {
+    flush();
+    if (_preallocated)
+        fresize(_fp, (long long)_frameCount*_frameSize);
+    fclose(_fp);
+
+    for (int i = 0; i < ReadbackDepth; i++)
+        delete _pbos[i];
+}
+
+void FrameStream::beginCapture() {
+    if (_pending == ReadbackDepth)
+        writeOldest();
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    _pbos[_head]->bind();
+}
+
+void FrameStream::endCapture() {
+    _pbos[_head]->unbind();
+    _head = (_head + 1) % ReadbackDepth;
+    _pending++;
+}
+
+void FrameStream::writeOldest() {
+    BufferObject *pbo = _pbos[(_head - _pending + ReadbackDepth) % ReadbackDepth];
+
+    pbo->bind();
+    pbo->map(MAP_READ);
+    if (_maxFrames == 0 || _frameCount < _maxFrames) {
+        fwrite(pbo->data(), 1, _frameSize, _fp);
+        _frameCount++;
+    }
+    pbo->unmap();
+    pbo->unbind();
+
+    _pending--;
+}
+
+void FrameStream::captureFramebuffer() {
+    beginCapture();
+    glReadPixels(0, 0, _width, _height, _glFormat, _glType, NULL);
+    endCapture();
+}
+
+void FrameStream::captureTexture(Texture &src) {
+    ASSERT(src.width() == _width && src.height() == _height, "Texture does not match the frame size\n");
+
+    /* src may have been written through image stores */
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+    beginCapture();
+    src.read(NULL, _glFormat, _glType);
+    endCapture();
+}
+
+void FrameStream::flush() {
+    while (_pending)
+        writeOldest();
+    fflush(_fp);
+}
@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#ifndef FRAMESTREAM_HPP_
+#define FRAMESTREAM_HPP_
+
+#include <stdio.h>
+#include <GL/gl.h>
+
+class BufferObject;
+class Texture;
+
+enum FrameFormat {
+    FRAME_GRAY8,
+    FRAME_RGB24,
+    FRAME_RGBA16F
+};
+
+/* Writes raw frames back to back, with no header, to stdout ("-"), a named
+ * pipe or a file, for an external encoder to consume. Pixels come back
+ * through a ring of pack buffers, so a frame is written a few captures
+ * after it was taken instead of stalling on the transfer. Rows are stored
+ * bottom to top as OpenGL returns them */
+class FrameStream {
+    static const int ReadbackDepth = 3;
+
+    FILE *_fp;
+    bool _preallocated;
+
+    GLenum _glFormat, _glType;
+    int _width, _height;
+    int _frameSize;
+    int _maxFrames;
+    int _frameCount;
+
+    BufferObject *_pbos[ReadbackDepth];
+    int _head;
+    int _pending;
+
+    void beginCapture();
+    void endCapture();
+    void writeOldest();
+
+public:
+    FrameStream(const char *path, FrameFormat format, int width, int height, int maxFrames = 0);
+    ~FrameStream();
+
+    void captureFramebuffer();
+    void captureTexture(Texture &src);
+    void flush();
+
+    int frameSize() const {
+        return _frameSize;
+    }
+
+    int frameCount() const {
+        return _frameCount;
+    }
+};
+
+#endif /* FRAMESTREAM_HPP_ */
@@ -28,8 +28,14 @@ freely, subject to the following restrictions:
 #include <GL/glew.h>
 #include <sys/time.h>
 #include <GL/freeglut.h>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 #include "render/RenderTarget.hpp"
+#include "render/Context.hpp"
 #include "render/MatrixStack.hpp"
 #include "render/Texture.hpp"
 #include "lodepng/lodepng.h"
@@ -38,24 +44,220 @@ freely, subject to the following restrictions:
 #include "math/Mat4.hpp"
 #include "Debug.hpp"
 #include "Fluid.hpp"
+#include "Fluid3D.hpp"
+#include "FrameStream.hpp"
+#include "FrameExchange.hpp"
+#include "FieldCache.hpp"
+#include "EditQueue.hpp"
 #include "Util.hpp"
 
+#ifndef _WIN32
+#include <X11/Xlib.h>
+#endif
+
 using namespace std;
 
 #define RECORD_FRAMES 0
+#define RECORD_THREADS 4
+#define RECORD_FAST 0
+#define SIMULATE_3D 0
+#define SLAB_COUNT 1
+#define DETERMINISTIC 0
+#define SCENE_OBSTACLE 0
+#define STREAM_FRAMES 0
+#define STREAM_PATH "-"
+#define STREAM_FORMAT FRAME_RGB24
+#define STREAM_MAX_FRAMES 0
+#define CACHE_FIELDS 0
+#define CACHE_PATH "Fields.gfc"
+#define CACHE_INTERVAL 10
+#define CACHE_ENCODING CACHE_FLOAT16
+#define SIMULATION_THREAD 1
+#define ADVECTION ADVECT_PARTICLES
+#define TRANSFER TRANSFER_FLIP
+#define BINNING BIN_ATOMIC
+#define TRACK_TILES 0
+#define REPORT_TIMING 0
+#define REPORT_INTERVAL 100
 
 const int GWidth = 1280;
 const int GHeight = 720;
+#if SIMULATE_3D
+const int FWidth = 96;
+const int FHeight = 64;
+const int FDepth = 48;
+
+static Fluid3D *fluid;
+#else
 const int FWidth = 640;
 const int FHeight = 360;
 
 static Fluid *fluid;
+#endif
 static Shader *quad;
+#if STREAM_FRAMES
+static FrameStream *stream;
+#endif
+#if CACHE_FIELDS && !SIMULATE_3D
+static FieldCache *cache;
+#endif
+static float simulationTime = 0.0f;
+
+#if SIMULATION_THREAD && !SIMULATE_3D
+static Context *simulationContext;
+static FrameExchange *exchange;
+static thread *simulationThread;
+static atomic<bool> simulationRunning(true);
+static mutex initMutex;
+static condition_variable initDone;
+static bool simulationReady = false;
+#endif
+
+#if !SIMULATE_3D
+/* Advances f by one frame in as many substeps as its velocity and forces
+ * allow. Returns the number of substeps */
+static int advance(Fluid *f, float deltaT) {
+    f->setup();
+    int substeps = (int)ceil(deltaT/min(f->estimatedTimestep(), f->maxTimestep()));
+    for (int i = 0; i < substeps; i++)
+        f->update(deltaT/substeps);
+    f->teardown();
+
+    return substeps;
+}
+#endif
+
+#if REPORT_TIMING && !SIMULATE_3D
+/* With a grid scheme selected, a second solver runs the same scene on
+ * particles so the report has something to compare against. Scene edits
+ * only reach the main solver */
+static Fluid *reference;
+
+struct TimingReport {
+    int frames, substeps;
+    double ms;
+};
+
+/* Waits for the GPU on both ends, so the numbers include the time it spent
+ * and none of the other solver's */
+static void timeFrame(Fluid *f, float deltaT, TimingReport &report) {
+    glFinish();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    report.substeps += advance(f, deltaT);
+    glFinish();
+    report.ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    report.frames++;
+}
+
+static void printReport(AdvectionScheme scheme, Fluid *f, TimingReport &report) {
+    static const char *schemes[] = {"particles", "semi-Lagrangian", "MacCormack"};
+
+    printf("%s: %.2f substeps/frame, %.1f ms/frame", schemes[scheme],
+            report.substeps/(double)report.frames, report.ms/report.frames);
+    if (scheme == ADVECT_PARTICLES)
+        printf(", %d particles", f->particles());
+    printf("\n");
 
+    report = TimingReport();
+}
+#endif
+
+/* Writes this frame's outputs from the simulation side, then advances the
+ * simulation by one frame. d is the density as shown on screen */
+static void simulate(Texture *d) {
+#if STREAM_FRAMES && SIMULATION_THREAD && !SIMULATE_3D
+    /* The display thread only captures the composited window */
+    if (STREAM_FORMAT == FRAME_GRAY8)
+        stream->captureTexture(*d);
+#endif
+
+#if CACHE_FIELDS && !SIMULATE_3D
+    static int cacheFrame = 0;
+    if (cacheFrame % CACHE_INTERVAL == 0) {
+        cache->beginFrame(cacheFrame, simulationTime);
+        cache->addField("density",     *fluid->density(), CACHE_ENCODING);
+        cache->addField("temperature", *fluid->t(),       CACHE_ENCODING);
+        cache->addField("u",           *fluid->u(),       CACHE_ENCODING);
+        cache->addField("v",           *fluid->v(),       CACHE_ENCODING);
+        cache->addField("pressure",    *fluid->p(),       CACHE_ENCODING);
+        cache->endFrame();
+    }
+    cacheFrame++;
+#endif
+
+#if RECORD_FRAMES
+    static int iteration = 0;
+    static unsigned char density[FWidth*FHeight], frame[FWidth*FHeight*3];
+    d->read(density, GL_RED, GL_UNSIGNED_BYTE);
+
+    for (int i = 0; i < FWidth*FHeight*3; i++)
+        frame[i] = max(0xFF - density[i/3], 0);
+
+    char path[1024];
+    sprintf(path, "Frame%05d.png", iteration++);
+
+    static LodePNGState state;
+    static LodePNGEncoderContext *encoder = 0;
+    if (!encoder) {
+        lodepng_state_init(&state);
+        state.info_raw.colortype = LCT_RGB;
+        state.info_png.color.colortype = LCT_RGB;
+        if (RECORD_FAST)
+            lodepng_encoder_settings_fast(&state.encoder);
+        state.encoder.zlibsettings.threads = RECORD_THREADS;
+        encoder = lodepng_encoder_context_new();
+    }
+
+    const unsigned char *png;
+    size_t pngSize;
+    if (!lodepng_encode_context(&png, &pngSize, frame, FWidth, FHeight, &state, encoder))
+        lodepng_save_file(png, pngSize, path);
+#endif
+
+    const float deltaT = 0.499f*1e-3*1920/FWidth;
+    simulationTime += deltaT;
+#if SIMULATE_3D
+    float T = 0.0;
+    while (T < deltaT) {
+        float dt = min(fluid->recommendedTimestep(), deltaT);
+        if (T + dt > deltaT) {
+            dt = deltaT - T;
+            T = deltaT;
+        }
+        fluid->update(dt);
+        T += dt;
+    }
+#else
+#if REPORT_TIMING
+    static TimingReport report, referenceReport;
+    timeFrame(fluid, deltaT, report);
+    if (reference)
+        timeFrame(reference, deltaT, referenceReport);
+
+    if (report.frames == REPORT_INTERVAL) {
+        printReport(ADVECTION, fluid, report);
+        if (reference)
+            printReport(ADVECT_PARTICLES, reference, referenceReport);
+    }
+#else
+    advance(fluid, deltaT);
+#endif
+#endif
+}
+
+#if !SIMULATION_THREAD || SIMULATE_3D
 static void render() {
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+#if SIMULATE_3D
+    Texture *d = fluid->projection();
+
+    d->bindAny();
+    quad->bind();
+    quad->uniformI("D", d->boundUnit());
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+#else
     Texture *d = fluid->density();
     Texture *u = fluid->u();
     Texture *v = fluid->v();
@@ -74,41 +276,47 @@ static void render() {
     quad->uniformI("P", p->boundUnit());
     quad->uniformI("T", t->boundUnit());
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+#endif
 
-#if RECORD_FRAMES
-    static int iteration = 0;
-    static unsigned char density[FWidth*FHeight], frame[FWidth*FHeight*3];
-    d->bindAny();
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, density);
-
-    for (int i = 0; i < FWidth*FHeight*3; i++)
-        frame[i] = max(0xFF - density[i/3], 0);
+#if STREAM_FRAMES
+    if (STREAM_FORMAT == FRAME_GRAY8)
+        stream->captureTexture(*d);
+    else
+        stream->captureFramebuffer();
+#endif
 
-    char path[1024];
-    sprintf(path, "Frame%05d.png", iteration++);
-    lodepng_encode24_file(path, frame, FWidth, FHeight);
+    simulate(d);
+}
 #endif
 
-    const float deltaT = 0.499f*1e-3*1920/FWidth;
-    fluid->setup();
-    float T = 0.0;
-    while (T < deltaT) {
-        float dt = min(fluid->recommendedTimestep(), 0.25f*1e-3f);
-        if (T + dt > deltaT) {
-            dt = deltaT - T;
-            T = deltaT;
-        }
-        fluid->update(dt);
-        T += dt;
+#if SIMULATION_THREAD && !SIMULATE_3D
+/* Display thread: shows the newest frame the simulation has published.
+ * The textures are bound by name, outside the Texture unit bookkeeping */
+static void present() {
+    glClearColor(0.0, 0.0, 0.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (exchange->acquire()) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, exchange->field(0));
+        quad->bind();
+        quad->uniformI("D", 0);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        exchange->release();
     }
-    fluid->teardown();
+
+#if STREAM_FRAMES
+    if (STREAM_FORMAT != FRAME_GRAY8)
+        stream->captureFramebuffer();
+#endif
 }
+#endif
 
 static void initShaders() {
     quad = new Shader("src/shaders/", "Preamble.txt", "Quad.vert", 0, "Quad.frag", 1);
 }
 
-static void initRender() {
+static void initSimulation() {
     glDebugMessageCallbackARB((GLDEBUGPROCARB)errorCallback, NULL);
     //glDebugMessageControlARB(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
 
@@ -118,42 +326,216 @@ static void initRender() {
 
     RenderTarget::resetViewport();
 
+#if SIMULATE_3D
+    fluid = new Fluid3D(FWidth, FHeight, FDepth);
+    if (SLAB_COUNT > 1)
+        fluid->decompose(SLAB_COUNT);
+#else
     fluid = new Fluid(FWidth, FHeight);
+    fluid->setAdvection(ADVECTION);
+    fluid->setTransfer(TRANSFER);
+    fluid->setBinning(BINNING);
+    fluid->setDeterministic(DETERMINISTIC);
+    fluid->setTileTracking(TRACK_TILES);
+#endif
     fluid->initScene();
+#if SCENE_OBSTACLE && !SIMULATE_3D
+    fluid->addSolidCircle(0.88, 0.45, 0.08);
+#endif
+
+#if REPORT_TIMING && !SIMULATE_3D
+    if (ADVECTION != ADVECT_PARTICLES) {
+        reference = new Fluid(FWidth, FHeight);
+        reference->setTransfer(TRANSFER);
+        reference->setBinning(BINNING);
+        reference->setDeterministic(DETERMINISTIC);
+        reference->setTileTracking(TRACK_TILES);
+        reference->initScene();
+#if SCENE_OBSTACLE
+        reference->addSolidCircle(0.88, 0.45, 0.08);
+#endif
+    }
+#endif
+
+#if STREAM_FRAMES
+    /* Gray8 streams the raw density field, the others the composited window */
+#if SIMULATE_3D
+    Texture *d = fluid->projection();
+#else
+    Texture *d = fluid->density();
+#endif
+    if (STREAM_FORMAT == FRAME_GRAY8)
+        stream = new FrameStream(STREAM_PATH, STREAM_FORMAT, d->width(), d->height(), STREAM_MAX_FRAMES);
+    else
+        stream = new FrameStream(STREAM_PATH, STREAM_FORMAT, GWidth, GHeight, STREAM_MAX_FRAMES);
+#endif
+
+#if CACHE_FIELDS && !SIMULATE_3D
+    cache = new FieldCache(CACHE_PATH);
+#endif
+}
+
+#if SIMULATION_THREAD && !SIMULATE_3D
+/* Simulates as fast as it can on its own context, independent of how often
+ * the window is presented */
+static void simulationLoop() {
+    simulationContext->makeCurrent();
+    initSimulation();
+
+    {
+        lock_guard<mutex> lock(initMutex);
+        simulationReady = true;
+    }
+    initDone.notify_all();
+
+    for (int frame = 0; simulationRunning; frame++) {
+        simulate(fluid->density());
+
+        /* Quad.frag only shows the density */
+        Texture *fields[] = {fluid->density()};
+        exchange->publish(fields, frame);
+    }
+
+    /* The stream is flushed from the main thread on exit */
+    glFinish();
+    simulationContext->release();
+}
+#endif
+
+static void initRender() {
+#if SIMULATION_THREAD && !SIMULATE_3D
+    glDebugMessageCallbackARB((GLDEBUGPROCARB)errorCallback, NULL);
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    simulationContext = new Context(true);
+    exchange = new FrameExchange(1);
+    simulationThread = new thread(simulationLoop);
+
+    /* The stream and cache are created on the simulation thread */
+    unique_lock<mutex> lock(initMutex);
+    initDone.wait(lock, [] { return simulationReady; });
+#else
+    initSimulation();
+#endif
 }
 
 static void initGl() {
     glewExperimental = GL_TRUE;
     glewInit();
     glGetError();
+
+    /* Texture storage, clears and persistent buffers need GL 4.4, and the
+     * default USE_DSA backend needs 4.5 */
+    if (!GLEW_VERSION_4_5)
+        FAIL("OpenGL 4.5 is required\n");
 }
 
 static void display() {
+#if SIMULATION_THREAD && !SIMULATE_3D
+    present();
+#else
     render();
+#endif
     glutSwapBuffers();
 }
 
+#if !SIMULATE_3D
+static float vorticity = 1.0f;
+static float gravity = -9.81f;
+static int dragButton = -1;
+
+/* Window coordinates to domain units, which span 1 along the shorter side */
+static void toDomain(int x, int y, float &fx, float &fy) {
+    float scale = 1.0f/min(FWidth, FHeight);
+    fx = (x/(float)GWidth)*FWidth*scale;
+    fy = (1.0f - y/(float)GHeight)*FHeight*scale;
+}
+
+/* Edits are only queued here; the simulation picks them up at its next step */
+static void mouse(int button, int state, int x, int y) {
+    dragButton = (state == GLUT_DOWN ? button : -1);
+    if (state != GLUT_DOWN)
+        return;
+
+    float fx, fy;
+    toDomain(x, y, fx, fy);
+
+    if (button == GLUT_LEFT_BUTTON)
+        fluid->edits()->addSolidCircle(fx, fy, 0.04f);
+    else if (button == GLUT_RIGHT_BUTTON)
+        fluid->edits()->addInflow(fx, fy, 0.1f, 0.01f, 200.0f);
+    else if (button == GLUT_MIDDLE_BUTTON)
+        fluid->edits()->moveInflow(0, fx, fy);
+}
+
+static void motion(int x, int y) {
+    if (dragButton != GLUT_MIDDLE_BUTTON)
+        return;
+
+    float fx, fy;
+    toDomain(x, y, fx, fy);
+
+    fluid->edits()->moveInflow(0, fx, fy);
+}
+#endif
+
 static void keyboard(unsigned char mkey, int x, int y) {
     switch(mkey) {
+#if !SIMULATE_3D
+        case 'c':
+            fluid->edits()->clearSolids();
+            break;
+        case 'v':
+        case 'V':
+            vorticity = max(vorticity + (mkey == 'V' ? 0.25f : -0.25f), 0.0f);
+            fluid->edits()->setParameter(PARAM_VORTICITY, vorticity);
+            break;
+        case 'g':
+        case 'G':
+            gravity += (mkey == 'G' ? 1.0f : -1.0f);
+            fluid->edits()->setParameter(PARAM_GRAVITY, gravity);
+            break;
+#endif
         case 0x1b:
+#if SIMULATION_THREAD && !SIMULATE_3D
+            simulationRunning = false;
+            simulationThread->join();
+#endif
+#if STREAM_FRAMES
+            delete stream;
+#endif
+#if CACHE_FIELDS && !SIMULATE_3D
+            delete cache;
+#endif
             exit(EXIT_SUCCESS);
             break;
     }
 }
 
 int main(int argc, char **argv) {
+#if SIMULATION_THREAD && !SIMULATE_3D && !defined(_WIN32)
+    /* The simulation thread uses GLUT's X display connection for its context */
+    XInitThreads();
+#endif
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | GLUT_STENCIL);
     glutInitWindowSize(GWidth, GHeight);
     glutInitWindowPosition(128, 128);
 
-    glutInitContextVersion(4, 3);
+    glutInitContextVersion(4, 5);
     glutInitContextFlags(GLUT_FORWARD_COMPATIBLE | GLUT_DEBUG);
     glutInitContextProfile(GLUT_CORE_PROFILE);
 
     glutCreateWindow("GPU Fluid Solver");
 
     glutKeyboardFunc(keyboard);
+#if !SIMULATE_3D
+    glutMouseFunc(mouse);
+    glutMotionFunc(motion);
+#endif
 
     initGl();
     initShaders();
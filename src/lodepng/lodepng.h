@@ -69,6 +69,13 @@ the custom_zlib field of the compress and decompress settings*/
 #ifndef LODEPNG_NO_COMPILE_ERROR_TEXT
 #define LODEPNG_COMPILE_ERROR_TEXT
 #endif
+/*multithreaded filtering and deflate, needs C++11 std::thread. Without it the threads
+setting of the compress settings is ignored*/
+#ifdef __cplusplus
+#ifndef LODEPNG_NO_COMPILE_THREADS
+#define LODEPNG_COMPILE_THREADS
+#endif
+#endif
 /*compile the C++ version (you can disable the C++ wrapper here even when compiling for C++)*/
 #ifdef __cplusplus
 #ifndef LODEPNG_NO_COMPILE_CPP
@@ -278,6 +285,10 @@ struct LodePNGCompressSettings /*deflate = compress*/
   unsigned minmatch; /*mininum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  /*filter and deflate large images on this many threads. The image is split into ranges that are
+  deflated independently and joined into one stream; a range still matches against the window of
+  bytes before it, so the output is only slightly larger. Default: 1*/
+  unsigned threads;
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -525,7 +536,12 @@ void lodepng_decoder_settings_init(LodePNGDecoderSettings* settings);
 typedef enum LodePNGFilterStrategy
 {
   /*every filter at zero*/
-  LFS_ZERO, 
+  LFS_ZERO = 0,
+  /*every filter at the given type: sub, up, average or paeth*/
+  LFS_ONE = 1,
+  LFS_TWO = 2,
+  LFS_THREE = 3,
+  LFS_FOUR = 4,
   /*Use filter that gives minumum sum, as described in the official PNG filter heuristic.*/
   LFS_MINSUM,
   /*Use the filter type that gives smallest Shannon entropy for this scanline. Depending
@@ -596,6 +612,9 @@ typedef struct LodePNGEncoderSettings
 } LodePNGEncoderSettings;
 
 void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings);
+/*Trades compression for speed, e.g. for previews: every scanline uses the paeth filter and
+LZ77 does a short greedy search. Call after lodepng_encoder_settings_init*/
+void lodepng_encoder_settings_fast(LodePNGEncoderSettings* settings);
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 
@@ -649,6 +668,36 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h,
 unsigned lodepng_encode(unsigned char** out, size_t* outsize,
                         const unsigned char* image, unsigned w, unsigned h,
                         LodePNGState* state);
+
+/*
+Keeps the filter attempts, converted and filtered image, deflate hash tables and
+output PNG between calls, so that encoding a stream of same sized frames does not
+allocate once it is warmed up. Not thread safe: use one context per encoding thread.
+*/
+typedef struct LodePNGEncoderContext LodePNGEncoderContext;
+
+/*returns NULL if allocation failed*/
+LodePNGEncoderContext* lodepng_encoder_context_new(void);
+void lodepng_encoder_context_delete(LodePNGEncoderContext* context);
+
+/*
+Same as lodepng_encode, but the output is owned by the context and stays valid
+until the next encode with, or deletion of, the context.
+*/
+unsigned lodepng_encode_context(const unsigned char** out, size_t* outsize,
+                                const unsigned char* image, unsigned w, unsigned h,
+                                LodePNGState* state, LodePNGEncoderContext* context);
+
+/*Encodes into a buffer of the caller. Gives error 90 if the PNG is larger than capacity.*/
+unsigned lodepng_encode_buffer(unsigned char* out, size_t capacity, size_t* outsize,
+                               const unsigned char* image, unsigned w, unsigned h,
+                               LodePNGState* state, LodePNGEncoderContext* context);
+
+#ifdef LODEPNG_COMPILE_DISK
+/*Encodes and writes the PNG to an open file descriptor, e.g. a pipe. Gives error 91 if writing failed.*/
+unsigned lodepng_encode_fd(int fd, const unsigned char* image, unsigned w, unsigned h,
+                           LodePNGState* state, LodePNGEncoderContext* context);
+#endif /*LODEPNG_COMPILE_DISK*/
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 /*
@@ -162,32 +162,97 @@ Mat4 Mat4::lookAt(const Vec3 &pos, const Vec3 &fwd, const Vec3 &up) {
 
 }
 
-Mat4 operator*(const Mat4 &a, const Mat4 &b) {
-    Mat4 result;
-    for (int i = 0; i < 4; i++)
-        for (int t = 0; t < 4; t++)
-            result.a[i*4 + t] =
-                a.a[i*4 + 0]*b.a[0*4 + t] +
-                a.a[i*4 + 1]*b.a[1*4 + t] +
-                a.a[i*4 + 2]*b.a[2*4 + t] +
-                a.a[i*4 + 3]*b.a[3*4 + t];
-
-    return result;
-}
-
-Vec4 operator*(const Mat4 &a, const Vec4 &b) {
-    return Vec4(
-        a.a11*b.x + a.a12*b.y + a.a13*b.z + a.a14*b.w,
-        a.a21*b.x + a.a22*b.y + a.a23*b.z + a.a24*b.w,
-        a.a31*b.x + a.a32*b.y + a.a33*b.z + a.a34*b.w,
-        a.a41*b.x + a.a42*b.y + a.a43*b.z + a.a44*b.w
-    );
+#if MATH_SSE
+static void transformSse(const Mat4 &m, const Vec3 *src, Vec3 *dst, int count, float w) {
+    __m128 c0 = m.rows[0], c1 = m.rows[1], c2 = m.rows[2], c3 = m.rows[3];
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    c3 = _mm_mul_ps(c3, _mm_set1_ps(w));
+
+    Vec4 r;
+    for (int i = 0; i < count; i++) {
+        r.v = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(src[i].x)), _mm_mul_ps(c1, _mm_set1_ps(src[i].y))),
+            _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(src[i].z)), c3));
+        dst[i] = Vec3(r.x, r.y, r.z);
+    }
 }
 
-Vec3 operator*(const Mat4 &a, const Vec3 &b) {
-    return Vec3(
-        a.a11*b.x + a.a12*b.y + a.a13*b.z + a.a14,
-        a.a21*b.x + a.a22*b.y + a.a23*b.z + a.a24,
-        a.a31*b.x + a.a32*b.y + a.a33*b.z + a.a34
-    );
+void transformPoints(const Mat4 &m, const Vec3 *src, Vec3 *dst, int count) {
+    transformSse(m, src, dst, count, 1.0f);
+}
+
+void transformVectors(const Mat4 &m, const Vec3 *src, Vec3 *dst, int count) {
+    transformSse(m, src, dst, count, 0.0f);
+}
+
+void transform(const Mat4 &m, const Vec4 *src, Vec4 *dst, int count) {
+    __m128 c[4] = {m.rows[0], m.rows[1], m.rows[2], m.rows[3]};
+    _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+
+    int i = 0;
+#if MATH_AVX
+    __m256 c0 = _mm256_broadcast_ps(&c[0]), c1 = _mm256_broadcast_ps(&c[1]);
+    __m256 c2 = _mm256_broadcast_ps(&c[2]), c3 = _mm256_broadcast_ps(&c[3]);
+    for (; i + 1 < count; i += 2) {
+        __m256 v = _mm256_loadu_ps(src[i].a);
+        __m256 r = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(c0, _mm256_shuffle_ps(v, v, 0x00)), _mm256_mul_ps(c1, _mm256_shuffle_ps(v, v, 0x55))),
+            _mm256_add_ps(_mm256_mul_ps(c2, _mm256_shuffle_ps(v, v, 0xAA)), _mm256_mul_ps(c3, _mm256_shuffle_ps(v, v, 0xFF))));
+        _mm256_storeu_ps(dst[i].a, r);
+    }
+#endif
+    for (; i < count; i++) {
+        __m128 v = src[i].v;
+        dst[i].v = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(c[0], _mm_shuffle_ps(v, v, 0x00)), _mm_mul_ps(c[1], _mm_shuffle_ps(v, v, 0x55))),
+            _mm_add_ps(_mm_mul_ps(c[2], _mm_shuffle_ps(v, v, 0xAA)), _mm_mul_ps(c[3], _mm_shuffle_ps(v, v, 0xFF))));
+    }
+}
+
+void multiply(const Mat4 *a, const Mat4 *b, Mat4 *dst, int count) {
+#if MATH_AVX
+    for (int n = 0; n < count; n++) {
+        __m256 b0 = _mm256_broadcast_ps(&b[n].rows[0]), b1 = _mm256_broadcast_ps(&b[n].rows[1]);
+        __m256 b2 = _mm256_broadcast_ps(&b[n].rows[2]), b3 = _mm256_broadcast_ps(&b[n].rows[3]);
+        __m256 r[2];
+        for (int i = 0; i < 2; i++) {
+            __m256 v = _mm256_loadu_ps(a[n].a + i*8);
+            r[i] = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(v, v, 0x00), b0), _mm256_mul_ps(_mm256_shuffle_ps(v, v, 0x55), b1)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(v, v, 0xAA), b2), _mm256_mul_ps(_mm256_shuffle_ps(v, v, 0xFF), b3)));
+        }
+        _mm256_storeu_ps(dst[n].a, r[0]);
+        _mm256_storeu_ps(dst[n].a + 8, r[1]);
+    }
+#else
+    for (int n = 0; n < count; n++)
+        dst[n] = a[n]*b[n];
+#endif
+}
+#else
+void transformPoints(const Mat4 &m, const Vec3 *src, Vec3 *dst, int count) {
+    for (int i = 0; i < count; i++)
+        dst[i] = m*src[i];
+}
+
+void transformVectors(const Mat4 &m, const Vec3 *src, Vec3 *dst, int count) {
+    for (int i = 0; i < count; i++) {
+        Vec3 v = src[i];
+        dst[i] = Vec3(
+            m.a11*v.x + m.a12*v.y + m.a13*v.z,
+            m.a21*v.x + m.a22*v.y + m.a23*v.z,
+            m.a31*v.x + m.a32*v.y + m.a33*v.z
+        );
+    }
 }
+
+void transform(const Mat4 &m, const Vec4 *src, Vec4 *dst, int count) {
+    for (int i = 0; i < count; i++)
+        dst[i] = m*src[i];
+}
+
+void multiply(const Mat4 *a, const Mat4 *b, Mat4 *dst, int count) {
+    for (int n = 0; n < count; n++)
+        dst[n] = a[n]*b[n];
+}
+#endif
@@ -24,10 +24,11 @@ freely, subject to the following restrictions:
 #ifndef MATH_MAT4_HPP_
 #define MATH_MAT4_HPP_
 
+#include "Simd.hpp"
 #include "Vec3.hpp"
 #include "Vec4.hpp"
 
-struct Mat4 {
+struct alignas(16) Mat4 {
     union {
         struct {
             float a11, a12, a13, a14;
@@ -36,6 +37,9 @@ struct Mat4 {
             float a41, a42, a43, a44;
         };
         float a[16];
+#if MATH_SSE
+        __m128 rows[4];
+#endif
     };
 
     Mat4 transpose() const;
@@ -58,8 +62,66 @@ struct Mat4 {
     static Mat4 lookAt(const Vec3 &pos, const Vec3 &fwd, const Vec3 &up);
 };
 
-Mat4 operator*(const Mat4 &a, const Mat4 &b);
-Vec4 operator*(const Mat4 &a, const Vec4 &b);
-Vec3 operator*(const Mat4 &a, const Vec3 &b);
+#if MATH_SSE
+inline Mat4 operator*(const Mat4 &a, const Mat4 &b) {
+    Mat4 result;
+    for (int i = 0; i < 4; i++) {
+        __m128 r = a.rows[i];
+        result.rows[i] = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(r, r, 0x00), b.rows[0]),
+                       _mm_mul_ps(_mm_shuffle_ps(r, r, 0x55), b.rows[1])),
+            _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(r, r, 0xAA), b.rows[2]),
+                       _mm_mul_ps(_mm_shuffle_ps(r, r, 0xFF), b.rows[3])));
+    }
+
+    return result;
+}
+
+inline Vec4 operator*(const Mat4 &a, const Vec4 &b) {
+    __m128 p0 = _mm_mul_ps(a.rows[0], b.v);
+    __m128 p1 = _mm_mul_ps(a.rows[1], b.v);
+    __m128 p2 = _mm_mul_ps(a.rows[2], b.v);
+    __m128 p3 = _mm_mul_ps(a.rows[3], b.v);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+
+    return Vec4(_mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+}
+#else
+inline Mat4 operator*(const Mat4 &a, const Mat4 &b) {
+    Mat4 result;
+    for (int i = 0; i < 4; i++)
+        for (int t = 0; t < 4; t++)
+            result.a[i*4 + t] =
+                a.a[i*4 + 0]*b.a[0*4 + t] +
+                a.a[i*4 + 1]*b.a[1*4 + t] +
+                a.a[i*4 + 2]*b.a[2*4 + t] +
+                a.a[i*4 + 3]*b.a[3*4 + t];
+
+    return result;
+}
+
+inline Vec4 operator*(const Mat4 &a, const Vec4 &b) {
+    return Vec4(
+        a.a11*b.x + a.a12*b.y + a.a13*b.z + a.a14*b.w,
+        a.a21*b.x + a.a22*b.y + a.a23*b.z + a.a24*b.w,
+        a.a31*b.x + a.a32*b.y + a.a33*b.z + a.a34*b.w,
+        a.a41*b.x + a.a42*b.y + a.a43*b.z + a.a44*b.w
+    );
+}
+#endif
+
+inline Vec3 operator*(const Mat4 &a, const Vec3 &b) {
+    return Vec3(
+        a.a11*b.x + a.a12*b.y + a.a13*b.z + a.a14,
+        a.a21*b.x + a.a22*b.y + a.a23*b.z + a.a24,
+        a.a31*b.x + a.a32*b.y + a.a33*b.z + a.a34
+    );
+}
+
+/* Batched versions of the products above. Source and destination may alias */
+void transformPoints(const Mat4 &m, const Vec3 *src, Vec3 *dst, int count);
+void transformVectors(const Mat4 &m, const Vec3 *src, Vec3 *dst, int count);
+void transform(const Mat4 &m, const Vec4 *src, Vec4 *dst, int count);
+void multiply(const Mat4 *a, const Mat4 *b, Mat4 *dst, int count);
 
 #endif
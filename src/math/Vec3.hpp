@@ -111,21 +111,65 @@ struct Vec3 {
     Vec3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
 };
 
-Vec3 operator-(const Vec3 &a);
-Vec3 operator+(const Vec3 &a, const Vec3 &b);
-Vec3 operator-(const Vec3 &a, const Vec3 &b);
-Vec3 operator*(const Vec3 &a, const Vec3 &b);
-Vec3 operator/(const Vec3 &a, const Vec3 &b);
-Vec3 operator*(const Vec3 &a, float b);
-Vec3 operator*(float a, const Vec3 &b);
-Vec3 operator/(const Vec3 &a, float b);
-Vec3 operator/(float a, const Vec3 &b);
-bool operator>(const Vec3 &a, const Vec3 &b);
-bool operator<(const Vec3 &a, const Vec3 &b);
-bool operator>=(const Vec3 &a, const Vec3 &b);
-bool operator<=(const Vec3 &a, const Vec3 &b);
-bool operator==(const Vec3 &a, const Vec3 &b);
-bool operator!=(const Vec3 &a, const Vec3 &b);
+inline Vec3 operator-(const Vec3 &a) {
+    return Vec3(-a.x, -a.y, -a.z);
+}
+
+inline Vec3 operator+(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+inline Vec3 operator-(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+inline Vec3 operator*(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a.x*b.x, a.y*b.y, a.z*b.z);
+}
+
+inline Vec3 operator/(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a.x/b.x, a.y/b.y, a.z/b.z);
+}
+
+inline Vec3 operator*(const Vec3 &a, float b) {
+    return Vec3(a.x*b, a.y*b, a.z*b);
+}
+
+inline Vec3 operator*(float a, const Vec3 &b) {
+    return Vec3(a*b.x, a*b.y, a*b.z);
+}
+
+inline Vec3 operator/(const Vec3 &a, float b) {
+    return Vec3(a.x/b, a.y/b, a.z/b);
+}
+
+inline Vec3 operator/(float a, const Vec3 &b) {
+    return Vec3(a/b.x, a/b.y, a/b.z);
+}
+
+inline bool operator>(const Vec3 &a, const Vec3 &b) {
+    return a.x > b.x && a.y > b.y && a.z > b.z;
+}
+
+inline bool operator<(const Vec3 &a, const Vec3 &b) {
+    return a.x < b.x && a.y < b.y && a.z < b.z;
+}
+
+inline bool operator>=(const Vec3 &a, const Vec3 &b) {
+    return a.x >= b.x && a.y >= b.y && a.z >= b.z;
+}
+
+inline bool operator<=(const Vec3 &a, const Vec3 &b) {
+    return a.x <= b.x && a.y <= b.y && a.z <= b.z;
+}
+
+inline bool operator==(const Vec3 &a, const Vec3 &b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+inline bool operator!=(const Vec3 &a, const Vec3 &b) {
+    return a.x != b.x || a.y != b.y || a.z != b.z;
+}
 
 Vec3 expf(const Vec3 &v);
 Vec3 powf(const Vec3 &v, float p);
@@ -41,66 +41,6 @@ Vec4 powf(const Vec4 &v, float p) {
     );
 }
 
-Vec4 operator-(const Vec4 &a) {
-    return Vec4(-a.x, -a.y, -a.z, -a.w);
-}
-
-Vec4 operator+(const Vec4 &a, const Vec4 &b) {
-    return Vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
-}
-
-Vec4 operator-(const Vec4 &a, const Vec4 &b) {
-    return Vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.z - b.z);
-}
-
-Vec4 operator*(const Vec4 &a, const Vec4 &b) {
-    return Vec4(a.x*b.x, a.y*b.y, a.z*b.z, a.w*b.w);
-}
-
-Vec4 operator/(const Vec4 &a, const Vec4 &b) {
-    return Vec4(a.x/b.x, a.y/b.y, a.z/b.z, a.w/b.w);
-}
-
-Vec4 operator*(const Vec4 &a, float b) {
-    return Vec4(a.x*b, a.y*b, a.z*b, a.w*b);
-}
-
-Vec4 operator*(float a, const Vec4 &b) {
-    return Vec4(a*b.x, a*b.y, a*b.z, a*b.w);
-}
-
-Vec4 operator/(const Vec4 &a, float b) {
-    return Vec4(a.x/b, a.y/b, a.z/b, a.w*b);
-}
-
-Vec4 operator/(float a, const Vec4 &b) {
-    return Vec4(a/b.x, a/b.y, a/b.z, a/b.w);
-}
-
-bool operator>(const Vec4 &a, const Vec4 &b) {
-    return a.x > b.x && a.y > b.y && a.z > b.z && a.w > b.w;
-}
-
-bool operator<(const Vec4 &a, const Vec4 &b) {
-    return a.x < b.x && a.y < b.y && a.z < b.z && a.w < b.w;
-}
-
-bool operator>=(const Vec4 &a, const Vec4 &b) {
-    return a.x >= b.x && a.y >= b.y && a.z >= b.z && a.w >= b.w;
-}
-
-bool operator<=(const Vec4 &a, const Vec4 &b) {
-    return a.x <= b.x && a.y <= b.y && a.z <= b.z && a.w <= b.w;
-}
-
-bool operator==(const Vec4 &a, const Vec4 &b) {
-    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
-}
-
-bool operator!=(const Vec4 &a, const Vec4 &b) {
-    return a.x != b.x || a.y != b.y || a.z != b.z || a.w != b.w;
-}
-
 std::ostream &operator<<(std::ostream &os, const Vec4 &v) {
     return os << "(" << v.x << ", " << v.y << ", " << v.z << ", " << v.w << ")";
 }
@@ -28,34 +28,80 @@ freely, subject to the following restrictions:
 #include <math.h>
 #include <ostream>
 
+#include "Simd.hpp"
 #include "Vec3.hpp"
 
-struct Vec4 {
+struct alignas(16) Vec4 {
     union {
         struct { float x, y, z, w; };
         float a[4];
+#if MATH_SSE
+        __m128 v;
+#endif
     };
 
+#if MATH_SSE
     Vec4 invert() const {
-        return Vec4(1.0f/x, 1.0f/y, 1.0f/z, 1.0f/w);
+        return Vec4(_mm_div_ps(_mm_set1_ps(1.0f), v));
     }
 
     float dot(const Vec4 &b) const {
-        return x*b.x + y*b.y + z*b.z + w*b.w;
+        __m128 p = _mm_mul_ps(v, b.v);
+        p = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1)));
+        p = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(p);
     }
 
-    float length() const {
-        return sqrtf(x*x + y*y + z*z + w*w);
+    Vec4 abs() const {
+        return Vec4(_mm_andnot_ps(_mm_set1_ps(-0.0f), v));
     }
 
-    Vec4 normalize() const {
-        float invSqrt = 1.0f/sqrtf(x*x + y*y + z*z + w*w);
+    Vec4 &operator+=(const Vec4 &b) {
+        v = _mm_add_ps(v, b.v);
+        return *this;
+    }
+
+    Vec4 &operator-=(const Vec4 &b) {
+        v = _mm_sub_ps(v, b.v);
+        return *this;
+    }
+
+    Vec4 &operator*=(const Vec4 &b) {
+        v = _mm_mul_ps(v, b.v);
+        return *this;
+    }
+
+    Vec4 &operator/=(const Vec4 &b) {
+        v = _mm_div_ps(v, b.v);
+        return *this;
+    }
+
+    Vec4 &operator*=(float b) {
+        v = _mm_mul_ps(v, _mm_set1_ps(b));
+        return *this;
+    }
+
+    Vec4 &operator/=(float b) {
+        v = _mm_div_ps(v, _mm_set1_ps(b));
+        return *this;
+    }
+
+    Vec4() : v(_mm_setzero_ps()) {}
+    Vec4(float s) : v(_mm_set1_ps(s)) {}
+    Vec4(float _x, float _y, float _z, float _w) : v(_mm_setr_ps(_x, _y, _z, _w)) {}
+    Vec4(const Vec3 &b, float _w = 1.0) : v(_mm_setr_ps(b.x, b.y, b.z, _w)) {}
+    explicit Vec4(__m128 _v) : v(_v) {}
+#else
+    Vec4 invert() const {
+        return Vec4(1.0f/x, 1.0f/y, 1.0f/z, 1.0f/w);
+    }
 
-        return Vec4(x*invSqrt, y*invSqrt, z*invSqrt, w*invSqrt);
+    float dot(const Vec4 &b) const {
+        return x*b.x + y*b.y + z*b.z + w*b.w;
     }
 
     Vec4 abs() const {
-        return Vec4(fabs(x), fabs(y), fabs(z), fabs(w));
+        return Vec4(fabsf(x), fabsf(y), fabsf(z), fabsf(w));
     }
 
     Vec4 &operator+=(const Vec4 &b) {
@@ -102,7 +148,7 @@ struct Vec4 {
         x /= b;
         y /= b;
         z /= b;
-        w *= b;
+        w /= b;
         return *this;
     }
 
@@ -110,23 +156,106 @@ struct Vec4 {
     Vec4(float s) : x(s), y(s), z(s), w(s) {}
     Vec4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
     Vec4(const Vec3 &b, float _w = 1.0) : x(b.x), y(b.y), z(b.z), w(_w) {}
+#endif
+
+    float length() const {
+        return sqrtf(dot(*this));
+    }
+
+    Vec4 normalize() const {
+        Vec4 r(*this);
+        return r *= 1.0f/length();
+    }
 };
 
-Vec4 operator-(const Vec4 &a);
-Vec4 operator+(const Vec4 &a, const Vec4 &b);
-Vec4 operator-(const Vec4 &a, const Vec4 &b);
-Vec4 operator*(const Vec4 &a, const Vec4 &b);
-Vec4 operator/(const Vec4 &a, const Vec4 &b);
-Vec4 operator*(const Vec4 &a, float b);
-Vec4 operator*(float a, const Vec4 &b);
-Vec4 operator/(const Vec4 &a, float b);
-Vec4 operator/(float a, const Vec4 &b);
-bool operator>(const Vec4 &a, const Vec4 &b);
-bool operator<(const Vec4 &a, const Vec4 &b);
-bool operator>=(const Vec4 &a, const Vec4 &b);
-bool operator<=(const Vec4 &a, const Vec4 &b);
-bool operator==(const Vec4 &a, const Vec4 &b);
-bool operator!=(const Vec4 &a, const Vec4 &b);
+inline Vec4 operator+(const Vec4 &a, const Vec4 &b) {
+    Vec4 r(a);
+    return r += b;
+}
+
+inline Vec4 operator-(const Vec4 &a, const Vec4 &b) {
+    Vec4 r(a);
+    return r -= b;
+}
+
+inline Vec4 operator*(const Vec4 &a, const Vec4 &b) {
+    Vec4 r(a);
+    return r *= b;
+}
+
+inline Vec4 operator/(const Vec4 &a, const Vec4 &b) {
+    Vec4 r(a);
+    return r /= b;
+}
+
+inline Vec4 operator-(const Vec4 &a) {
+    return Vec4(0.0f) - a;
+}
+
+inline Vec4 operator*(const Vec4 &a, float b) {
+    Vec4 r(a);
+    return r *= b;
+}
+
+inline Vec4 operator*(float a, const Vec4 &b) {
+    Vec4 r(b);
+    return r *= a;
+}
+
+inline Vec4 operator/(const Vec4 &a, float b) {
+    Vec4 r(a);
+    return r /= b;
+}
+
+inline Vec4 operator/(float a, const Vec4 &b) {
+    return Vec4(a)/b;
+}
+
+#if MATH_SSE
+inline bool operator>(const Vec4 &a, const Vec4 &b) {
+    return _mm_movemask_ps(_mm_cmpgt_ps(a.v, b.v)) == 0xF;
+}
+
+inline bool operator<(const Vec4 &a, const Vec4 &b) {
+    return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)) == 0xF;
+}
+
+inline bool operator>=(const Vec4 &a, const Vec4 &b) {
+    return _mm_movemask_ps(_mm_cmpge_ps(a.v, b.v)) == 0xF;
+}
+
+inline bool operator<=(const Vec4 &a, const Vec4 &b) {
+    return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)) == 0xF;
+}
+
+inline bool operator==(const Vec4 &a, const Vec4 &b) {
+    return _mm_movemask_ps(_mm_cmpeq_ps(a.v, b.v)) == 0xF;
+}
+#else
+inline bool operator>(const Vec4 &a, const Vec4 &b) {
+    return a.x > b.x && a.y > b.y && a.z > b.z && a.w > b.w;
+}
+
+inline bool operator<(const Vec4 &a, const Vec4 &b) {
+    return a.x < b.x && a.y < b.y && a.z < b.z && a.w < b.w;
+}
+
+inline bool operator>=(const Vec4 &a, const Vec4 &b) {
+    return a.x >= b.x && a.y >= b.y && a.z >= b.z && a.w >= b.w;
+}
+
+inline bool operator<=(const Vec4 &a, const Vec4 &b) {
+    return a.x <= b.x && a.y <= b.y && a.z <= b.z && a.w <= b.w;
+}
+
+inline bool operator==(const Vec4 &a, const Vec4 &b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+#endif
+
+inline bool operator!=(const Vec4 &a, const Vec4 &b) {
+    return !(a == b);
+}
 
 Vec4 expf(const Vec4 &v);
 Vec4 powf(const Vec4 &v, float p);
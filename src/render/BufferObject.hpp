@@ -32,7 +32,8 @@ enum BufferType {
     PIXEL_PACK_BUFFER,
     PIXEL_UNPACK_BUFFER,
     SHADER_STORAGE_BUFFER,
-    UNIFORM_BUFFER
+    UNIFORM_BUFFER,
+    DRAW_INDIRECT_BUFFER
 };
 
 enum MapFlags {
@@ -41,7 +42,9 @@ enum MapFlags {
     MAP_INVALIDATE_RANGE = (1 << 2),
     MAP_INVALIDATE       = (1 << 3),
     MAP_FLUSH_EXPLICIT   = (1 << 4),
-    MAP_UNSYCHRONIZED    = (1 << 5)
+    MAP_UNSYCHRONIZED    = (1 << 5),
+    MAP_PERSISTENT       = (1 << 6),
+    MAP_COHERENT         = (1 << 7)
 };
 
 class BufferObject {
@@ -58,6 +61,7 @@ public:
     BufferObject(BufferType type);
     BufferObject(BufferType type, GLsizei size);
     void init(GLsizei size);
+    void initStorage(GLsizei size, int flags = MAP_WRITE | MAP_PERSISTENT | MAP_COHERENT);
 
     void map(int flags = MAP_READ | MAP_WRITE | MAP_INVALIDATE);
     void mapRange(GLintptr offset, GLsizeiptr length, int flags = MAP_READ | MAP_WRITE | MAP_INVALIDATE_RANGE);
@@ -74,6 +78,7 @@ public:
     void unbindIndexed(int index);
 
     void copyData(void *data, GLsizei size, GLenum usage);
+    void copySubData(const void *data, GLintptr offset, GLsizeiptr size);
 
     GLuint glName() const {
         return _glName;
@@ -0,0 +1,102 @@
+/*
+Copyright (c) 2013 Benedikt Bitterli
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+   1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+
+   2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+
+   3. This notice may not be removed or altered from any source
+   distribution.
+*/
+
+#include <GL/glew.h>
+#include <string.h>
+
+#include "FramebufferCache.hpp"
+#include "RenderTarget.hpp"
+#include "Texture.hpp"
+#include "Debug.hpp"
+
+bool FramebufferCache::Key::operator<(const Key &b) const {
+    int c = memcmp(textures, b.textures, sizeof(textures));
+    if (c)
+        return c < 0;
+    if (width != b.width)
+        return width < b.width;
+    return height < b.height;
+}
+
+FramebufferCache::FramebufferCache() : _bound(0) {}
+
+FramebufferCache::~FramebufferCache() {
+    for (std::map<Key, RenderTarget *>::iterator i = _targets.begin(); i != _targets.end(); ++i)
+        delete i->second;
+}
+
+void FramebufferCache::bind(const Key &key, int count) {
+    std::map<Key, RenderTarget *>::iterator i = _targets.find(key);
+
+    RenderTarget *rt;
+    if (i == _targets.end()) {
+        rt = new RenderTarget();
+        rt->bind();
+
+        for (int t = 0; t < count; t++)
+            rt->attachTexture(*key.textures[t], t);
+        if (!count)
+            rt->setDefaultSize(key.width, key.height);
+        rt->selectAttachments(count);
+
+        ASSERT(rt->complete(), "Incomplete framebuffer with %d attachments\n", count);
+
+        _targets[key] = rt;
+    } else {
+        rt = i->second;
+        if (rt != _bound)
+            rt->bind();
+    }
+
+    _bound = rt;
+}
+
+void FramebufferCache::bind(const Texture &a) {
+    Key key = {{&a, 0, 0, 0}, 0, 0};
+    bind(key, 1);
+}
+
+void FramebufferCache::bind(const Texture &a, const Texture &b) {
+    Key key = {{&a, &b, 0, 0}, 0, 0};
+    bind(key, 2);
+}
+
+void FramebufferCache::bind(const Texture &a, const Texture &b, const Texture &c) {
+    Key key = {{&a, &b, &c, 0}, 0, 0};
+    bind(key, 3);
+}
+
+void FramebufferCache::bind(const Texture &a, const Texture &b, const Texture &c, const Texture &d) {
+    Key key = {{&a, &b, &c, &d}, 0, 0};
+    bind(key, 4);
+}
+
+void FramebufferCache::bindEmpty(int width, int height) {
+    Key key = {{0, 0, 0, 0}, width, height};
+    bind(key, 0);
+}
+
+void FramebufferCache::unbind() {
+    RenderTarget::unbind();
+    _bound = 0;
+}
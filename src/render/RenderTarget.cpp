@@ -22,6 +22,7 @@ freely, subject to the following restrictions:
 */
 
 #include <GL/glew.h>
+#include <algorithm>
 #include <cstdarg>
 
 #include "RenderTarget.hpp"
@@ -44,16 +45,20 @@ static const RtAttachment simpleOrder[] = {
     RT_ATTACHMENT4, RT_ATTACHMENT5, RT_ATTACHMENT6, RT_ATTACHMENT7,
 };
 
-int RenderTarget::_attachmentCount = 1;
-RtAttachment RenderTarget::_selectedAttachments[MaxAttachments] = {RT_ATTACHMENT0};
 std::stack<Viewport> RenderTarget::_viewports;
 int RenderTarget::_viewportX = -1;
 int RenderTarget::_viewportY = -1;
 int RenderTarget::_viewportW = -1;
 int RenderTarget::_viewportH = -1;
 
-RenderTarget::RenderTarget() {
+RenderTarget::RenderTarget() : _attachmentCount(1) {
+#if USE_DSA
+    glCreateFramebuffers(1, &_glName);
+#else
     glGenFramebuffers(1, &_glName);
+#endif
+
+    _selectedAttachments[0] = RT_ATTACHMENT0;
 
     for (int i = 0; i < MaxAttachments; i++) {
         _attachments     [i] = 0;
@@ -101,24 +106,26 @@ void RenderTarget::selectAttachments(int num, const RtAttachment bufs[]) {
     if (attachmentSwapRequired(num, bufs)) {
         _attachmentCount = num;
 
-        if (!num) {
-            GLenum target = GL_NONE;
-            glDrawBuffers(1, &target);
-        } else {
-            GLenum selected[MaxAttachments];
-
-            for (int i = 0; i < num; i++) {
-                selected[i] = targets[bufs[i]];
-                _selectedAttachments[i] = bufs[i];
-            }
-
-            glDrawBuffers(num, selected);
+        GLenum selected[MaxAttachments] = {GL_NONE};
+        for (int i = 0; i < num; i++) {
+            selected[i] = targets[bufs[i]];
+            _selectedAttachments[i] = bufs[i];
         }
+
+#if USE_DSA
+        glNamedFramebufferDrawBuffers(_glName, std::max(num, 1), selected);
+#else
+        glDrawBuffers(std::max(num, 1), selected);
+#endif
     }
 }
 
 void RenderTarget::setReadBuffer(RtAttachment buf) {
+#if USE_DSA
+    glNamedFramebufferReadBuffer(_glName, targets[buf]);
+#else
     glReadBuffer(targets[buf]);
+#endif
 }
 
 RtAttachment RenderTarget::attachTextureAny(const Texture &tex) {
@@ -149,6 +156,12 @@ void RenderTarget::attachTexture(const Texture &tex, int index, int level) {
     _attachmentTicket[index] = _nextTicket++;
     _attachments     [index] = &tex;
 
+#if USE_DSA
+    if (tex.type() == TEXTURE_BUFFER)
+        FAIL("Cannot attach texture buffer to FBO\n");
+
+    glNamedFramebufferTexture(_glName, GL_COLOR_ATTACHMENT0 + index, tex.glName(), level);
+#else
     switch(tex.type()) {
     case TEXTURE_BUFFER:
         FAIL("Cannot attach texture buffer to FBO\n");
@@ -164,16 +177,38 @@ void RenderTarget::attachTexture(const Texture &tex, int index, int level) {
         glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + index, tex.glName(), level);
         break;
     }
+#endif
 }
 
 void RenderTarget::detachTexture(int index) {
     if (_attachments[index]) {
         _attachments[index] = 0;
         _attachmentTicket[index] = 0;
+#if USE_DSA
+        glNamedFramebufferTexture(_glName, GL_COLOR_ATTACHMENT0 + index, 0, 0);
+#else
         glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + index, 0, 0);
+#endif
     }
 }
 
+#if USE_DSA
+void RenderTarget::attachDepthBuffer(const Texture &tex) {
+    glNamedFramebufferTexture(_glName, GL_DEPTH_ATTACHMENT, tex.glName(), 0);
+}
+
+void RenderTarget::attachDepthStencilBuffer(const Texture &tex) {
+    glNamedFramebufferTexture(_glName, GL_DEPTH_STENCIL_ATTACHMENT, tex.glName(), 0);
+}
+
+void RenderTarget::detachDepthBuffer() {
+    glNamedFramebufferTexture(_glName, GL_DEPTH_ATTACHMENT, 0, 0);
+}
+
+void RenderTarget::detachDepthStencilBuffer() {
+    glNamedFramebufferTexture(_glName, GL_DEPTH_STENCIL_ATTACHMENT, 0, 0);
+}
+#else
 void RenderTarget::attachDepthBuffer(const Texture &tex) {
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex.glName(), 0);
 }
@@ -189,6 +224,25 @@ void RenderTarget::detachDepthBuffer() {
 void RenderTarget::detachDepthStencilBuffer() {
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
 }
+#endif
+
+void RenderTarget::setDefaultSize(int width, int height) {
+#if USE_DSA
+    glNamedFramebufferParameteri(_glName, GL_FRAMEBUFFER_DEFAULT_WIDTH,  width);
+    glNamedFramebufferParameteri(_glName, GL_FRAMEBUFFER_DEFAULT_HEIGHT, height);
+#else
+    glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_WIDTH,  width);
+    glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_HEIGHT, height);
+#endif
+}
+
+bool RenderTarget::complete() {
+#if USE_DSA
+    return glCheckNamedFramebufferStatus(_glName, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+#else
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+#endif
+}
 
 void RenderTarget::bind() {
     glBindFramebuffer(GL_FRAMEBUFFER, _glName);
@@ -48,13 +48,14 @@ struct Viewport {
 
 class RenderTarget {
     static const int MaxAttachments = 8;
-    static int _attachmentCount;
-    static RtAttachment _selectedAttachments[MaxAttachments];
     static std::stack<Viewport> _viewports;
 
     static int _viewportX, _viewportY;
     static int _viewportW, _viewportH;
 
+    int _attachmentCount;
+    RtAttachment _selectedAttachments[MaxAttachments];
+
     int _nextTicket;
     int _attachmentTicket[MaxAttachments];
     const Texture *_attachments[MaxAttachments];
@@ -80,6 +81,8 @@ public:
     void detachTexture(int index);
     void detachDepthBuffer();
     void detachDepthStencilBuffer();
+    void setDefaultSize(int width, int height);
+    bool complete();
 
     void bind();
 
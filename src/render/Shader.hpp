@@ -46,7 +46,7 @@ union UniformValue {
     float f;
     int i2[2];
     int i3[3];
-    int i4[3];
+    int i4[4];
     float f2[2];
     float f3[3];
     float f4[4];
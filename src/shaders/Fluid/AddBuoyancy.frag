@@ -1,6 +1,5 @@
 uniform sampler2D T;
 uniform sampler2D V;
-uniform float Timestep;
 uniform float G;
 uniform float Density;
 uniform float TAmb;
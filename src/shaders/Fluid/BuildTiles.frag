@@ -0,0 +1,16 @@
+layout(pixel_center_integer) in vec4 gl_FragCoord;
+
+out float FragColor0;
+
+void main() {
+    ivec2 base = ivec2(gl_FragCoord.xy)*TILE_SIZE;
+    ivec2 end  = min(base + TILE_SIZE, ivec2(WIDTH - 1, HEIGHT - 1));
+    
+    float used = 0.0;
+    for (int y = base.y; y < end.y; y++)
+        for (int x = base.x; x < end.x; x++)
+            if (!solidCell(ivec2(x, y)))
+                used = 1.0;
+    
+    FragColor0 = used;
+}
\ No newline at end of file
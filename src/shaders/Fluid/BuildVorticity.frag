@@ -1,6 +1,5 @@
 uniform sampler2D U;
 uniform sampler2D V;
-uniform float Scale;
 
 in vec2 vCoord;
 
@@ -17,7 +16,7 @@ void main() {
         float U1 = texture(U, (vCoord + vec2( 0.5,  1.0))*scale).r;
         float V0 = texture(V, (vCoord + vec2(-1.0,  0.5))*scale).r;
         float V1 = texture(V, (vCoord + vec2( 1.0,  0.5))*scale).r;
-        W  = ((V1 - V0) - (U1 - U0))*Scale;
+        W  = ((V1 - V0) - (U1 - U0))*CurlScale;
     }
     
     FragColor0 = W;
@@ -13,10 +13,10 @@ void main() {
     
     if (A == marker) {
         float A1 = marker, A2 = marker, A3 = marker, A4 = marker;
-        if (coord.x > 0) A1 = texelFetchOffset(D, coord, 0, ivec2(-1,  0)).r;
-        if (coord.y > 0) A2 = texelFetchOffset(D, coord, 0, ivec2( 0, -1)).r;
-        if (coord.x < WIDTH - 1)  A3 = texelFetchOffset(D, coord, 0, ivec2(1, 0)).r;
-        if (coord.y < HEIGHT - 1) A4 = texelFetchOffset(D, coord, 0, ivec2(0, 1)).r;
+        if (coord.x > 0 && !solidCell(coord + ivec2(-1, 0))) A1 = texelFetchOffset(D, coord, 0, ivec2(-1,  0)).r;
+        if (coord.y > 0 && !solidCell(coord + ivec2(0, -1))) A2 = texelFetchOffset(D, coord, 0, ivec2( 0, -1)).r;
+        if (coord.x < WIDTH - 1  && !solidCell(coord + ivec2(1, 0))) A3 = texelFetchOffset(D, coord, 0, ivec2(1, 0)).r;
+        if (coord.y < HEIGHT - 1 && !solidCell(coord + ivec2(0, 1))) A4 = texelFetchOffset(D, coord, 0, ivec2(0, 1)).r;
         
         vec2 Sum = vec2(0.0);
         
@@ -0,0 +1,57 @@
+uniform sampler2D D;
+uniform sampler2D Forward;
+uniform sampler2D Backward;
+uniform sampler2D U;
+uniform sampler2D V;
+uniform vec2 Offset;
+uniform ivec2 Limits;
+
+in vec2 vCoord;
+
+out float FragColor0;
+
+const vec2 scale  = vec2(1.0/T_WIDTH, 1.0/T_HEIGHT);
+
+vec2 velocity(vec2 pos) {
+    return vec2(texture(U, pos*scale + vec2(0.0, -0.5*scale.y)).r, texture(V, pos*scale + vec2(-0.5*scale.x, 0.0)).r)*InvHx;
+}
+
+vec2 rungeKutta3(vec2 pos) {
+    vec2 first = velocity(pos);
+    vec2 midPos = pos - 0.5*Timestep*first;
+    vec2 mid = velocity(midPos);
+    vec2 lastPos = pos - 0.75*Timestep*mid;
+    vec2 last = velocity(lastPos);
+    
+    return -Timestep*((2.0/9.0)*first + (3.0/9.0)*mid + (4.0/9.0)*last);
+}
+
+void main() {
+    ivec2 coord = ivec2(vCoord);
+    vec2 fCoord = vec2(coord) + 0.5;
+    vec2 pos = fCoord + rungeKutta3(fCoord + Offset);
+    
+    if (solidCell(clamp(ivec2(pos), ivec2(0), Limits)))
+        pos = fCoord;
+    
+    ivec2 iPos = ivec2(pos - 0.5);
+    ivec4 xy = max(min(ivec4(iPos, iPos + 1), Limits.xyxy), 0);
+    
+    vec4 c = vec4(
+        texelFetch(D, xy.xy, 0).r,
+        texelFetch(D, xy.zy, 0).r,
+        texelFetch(D, xy.xw, 0).r,
+        texelFetch(D, xy.zw, 0).r
+    );
+    
+    float dMin = min(min(c.x, c.y), min(c.z, c.w));
+    float dMax = max(max(c.x, c.y), max(c.z, c.w));
+    
+    float forward  = texelFetch(Forward,  coord, 0).r;
+    float backward = texelFetch(Backward, coord, 0).r;
+    float original = texelFetch(D,        coord, 0).r;
+    
+    /* Half the round trip error corrects the forward step. Clamping to the
+     * cells the backtrace landed in keeps the scheme from overshooting */
+    FragColor0 = clamp(forward + 0.5*(original - backward), dMin, dMax);
+}
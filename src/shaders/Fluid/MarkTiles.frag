@@ -0,0 +1,36 @@
+uniform usampler2D Counts;
+uniform usampler2D Offsets;
+
+uniform sampler2D Q;
+
+uniform vec4 Rest;
+uniform vec4 Threshold;
+
+layout(pixel_center_integer) in vec4 gl_FragCoord;
+
+out float FragColor0;
+
+const float marker = uintBitsToFloat(0xDEADBEEFu);
+
+void main() {
+    ivec2 base = ivec2(gl_FragCoord.xy)*TILE_SIZE;
+    ivec2 end  = min(base + TILE_SIZE, ivec2(WIDTH - 1, HEIGHT - 1));
+    
+    for (int y = base.y; y < end.y; y++) {
+        for (int x = base.x; x < end.x; x++) {
+            int offset = int(texelFetch(Offsets, ivec2(x, y), 0).r);
+            int count  = int(texelFetch( Counts, ivec2(x, y), 0).r >> uint(28));
+            
+            for (int i = 0; i < count; i++) {
+                vec4 qs = texelFetch(Q, ivec2((offset + i) % PointInfo.x, (offset + i)/PointInfo.x), 0);
+                
+                if (qs.r != marker && any(greaterThan(abs(qs - Rest), Threshold))) {
+                    FragColor0 = 1.0;
+                    return;
+                }
+            }
+        }
+    }
+    
+    FragColor0 = 0.0;
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+uniform vec3 Circle;
+
+in vec2 vCoord;
+
+out float FragColor0;
+
+void main() {
+    if (Circle.z > 0.0 && distance(vec2(ivec2(vCoord)) + 0.5, Circle.xy) > Circle.z)
+        discard;
+    
+    FragColor0 = 1.0;
+}
\ No newline at end of file
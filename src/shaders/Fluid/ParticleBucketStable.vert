@@ -0,0 +1,45 @@
+layout(r32ui) uniform uimage2D Counts;
+layout(r32ui) uniform uimage2D Placed;
+layout(r32ui) uniform uimage2D Next;
+layout(rg32f) uniform image2D ResultP;
+layout(rgba32f) uniform image2D ResultQ;
+layout(rgba32f) uniform image2D ResultG;
+
+uniform usampler2D Offsets;
+uniform sampler2D PPos;
+uniform sampler2D Q;
+uniform sampler2D G;
+uniform bool Affine;
+uniform int Slot;
+
+/* One pass per bucket slot. Placed holds the key of the particle that
+ * won the previous slot of each cell (zero once a cell has run out) and
+ * the remaining particles compete for the next one with an atomic max.
+ * Keys decrease with the particle index, so every bucket ends up in index
+ * order regardless of scheduling */
+void main() {
+    ivec2 coord = ivec2(gl_VertexID % PointInfo.x, gl_VertexID/PointInfo.x);
+    vec2 pos = texelFetch(PPos, coord, 0).xy;
+    vec4 qs  = texelFetch(Q, coord, 0);
+    ivec2 src = coord;
+    ivec2 iPos = ivec2(pos - 0.0);
+    
+    uint key = ~uint(gl_VertexID + 1);
+    uint placed = Slot == 0 ? ~0u : imageLoad(Placed, iPos).r;
+    int capacity = int(imageLoad(Counts, iPos).r >> 28u);
+    
+    if (Slot > 0 && key == placed) {
+        int offset = int(texelFetch(Offsets, iPos, 0).r) + Slot - 1;
+        coord = ivec2(offset % PointInfo.x, offset/PointInfo.x);
+        
+        imageAtomicAdd(Counts, iPos, uint(-1));
+        imageStore(ResultP, coord, pos.xyxy);
+        imageStore(ResultQ, coord, qs);
+        if (Affine) {
+            imageStore(ResultG, coord, texelFetch(G, src, 0));
+        }
+    } else if (key < placed && Slot < capacity)
+        imageAtomicMax(Next, iPos, key);
+    
+    gl_Position = vec4(10000.0, 10000.0, 10000.0, 1.0);
+}
\ No newline at end of file
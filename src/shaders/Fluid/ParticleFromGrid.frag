@@ -8,7 +8,6 @@ uniform sampler2D UOld;
 uniform sampler2D VOld;
 uniform sampler2D TOld;
 uniform sampler2D DOld;
-uniform ivec2 PointInfo;
 
 layout(pixel_center_integer) in vec4 gl_FragCoord;
 
@@ -0,0 +1,63 @@
+uniform sampler2D PPos;
+uniform sampler2D Q;
+uniform sampler2D D;
+uniform sampler2D T;
+uniform sampler2D U;
+uniform sampler2D V;
+uniform sampler2D TOld;
+uniform sampler2D DOld;
+
+layout(pixel_center_integer) in vec4 gl_FragCoord;
+
+out vec4 FragColor0;
+out vec4 FragColor1;
+
+vec4 fetchNodes(sampler2D S, ivec4 xy) {
+    return vec4(
+        texelFetch(S, xy.xy, 0).r,
+        texelFetch(S, xy.zy, 0).r,
+        texelFetch(S, xy.xw, 0).r,
+        texelFetch(S, xy.zw, 0).r
+    );
+}
+
+float interpolate(vec4 n, vec2 f) {
+    return mix(mix(n.x, n.y, f.x), mix(n.z, n.w, f.x), f.y);
+}
+
+/* Gradient of the bilinear interpolant, which is what APIC needs for
+ * multilinear weights */
+vec2 gradient(vec4 n, vec2 f) {
+    return vec2(mix(n.y - n.x, n.w - n.z, f.y), mix(n.z - n.x, n.w - n.y, f.x));
+}
+
+void main() {
+    const float marker = uintBitsToFloat(0xDEADBEEFu);
+    
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    int index = coord.x + coord.y*PointInfo.x;
+    if (index >= PointInfo.y)
+        discard;
+    
+    vec2 pos = texelFetch(PPos, coord, 0).xy;
+    vec4 qs  = texelFetch(Q,    coord, 0);
+    ivec2 base = clamp(ivec2(pos), ivec2(0), ivec2(WIDTH - 2, HEIGHT - 2));
+    vec2 f = pos - vec2(base);
+    ivec4 xy = ivec4(base, base + 1);
+    
+    vec4 d = fetchNodes(D, xy);
+    vec4 t = fetchNodes(T, xy);
+    vec4 u = fetchNodes(U, xy);
+    vec4 v = fetchNodes(V, xy);
+    
+    /* Density and temperature are carried by the change over the step as
+     * in FLIP, since resampling them outright diffuses them away */
+    vec2 dt;
+    if (qs.x == marker)
+        dt = vec2(interpolate(d, f), interpolate(t, f));
+    else
+        dt = qs.xy + vec2(interpolate(d - fetchNodes(DOld, xy), f), interpolate(t - fetchNodes(TOld, xy), f));
+    
+    FragColor0 = vec4(dt, interpolate(u, f), interpolate(v, f));
+    FragColor1 = vec4(gradient(u, f), gradient(v, f));
+}
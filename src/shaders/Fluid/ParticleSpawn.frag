@@ -5,7 +5,6 @@ layout(pixel_center_integer) in vec4 gl_FragCoord;
 layout(rg32f) uniform image2D ResultP;
 layout(rgba32f) uniform image2D ResultQ;
 
-uniform ivec2 PointInfo;
 
 vec2 rand(uvec2 p) {
     const uint M = 1664525u, C = 1013904223u;
@@ -3,8 +3,9 @@ uniform usampler2D Offsets;
 
 uniform sampler2D PPos;
 uniform sampler2D Q;
+uniform sampler2D G;
+uniform bool Affine;
 
-uniform ivec2 PointInfo;
 
 layout(pixel_center_integer) in vec4 gl_FragCoord;
 
@@ -30,6 +31,12 @@ void evalContribution(ivec2 iCoord, inout vec4 C, inout float W) {
             vec2 pos = texelFetch(PPos, coord, 0).xy;
             vec2 d = max(1.0 - abs(pos - gl_FragCoord.xy), 0.0);
             
+            if (Affine) {
+                vec2 dx = gl_FragCoord.xy - pos;
+                vec4 g = texelFetch(G, coord, 0);
+                qs.zw += vec2(dot(g.xy, dx), dot(g.zw, dx));
+            }
+            
             W += d.x*d.y;
             C += qs*d.x*d.y;
         }
@@ -39,6 +46,11 @@ void evalContribution(ivec2 iCoord, inout vec4 C, inout float W) {
 void main() {
     ivec2 iCoord = ivec2(gl_FragCoord.xy);
     
+    if (solidCell(iCoord)) {
+        FragColor0 = FragColor1 = FragColor2 = FragColor3 = 0.0;
+        return;
+    }
+    
     vec4 C = vec4(0.0);
     float W = 0.0;
     evalContribution(iCoord + ivec2(-1, -1), C, W);